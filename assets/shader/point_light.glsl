@@ -21,14 +21,19 @@ uniform vec2 uv_scale;
 uniform sampler2D normal_buffer;
 uniform sampler2D depth_buffer;
 uniform mat4 p;
-uniform vec3 light_pos;
-uniform float light_radius;
-uniform vec3 light_color;
 uniform vec3 frustum[4];
+
+// lights are either drawn one at a time on a sphere mesh, or in batches on a screen tile
+// must match MAX_TILE_LIGHTS in loop.h
+const int max_lights = 16;
+uniform int light_count;
+uniform vec3 light_pos[max_lights];
+uniform float light_radius[max_lights];
+uniform vec3 light_color[max_lights];
 const int type_normal = 1;
 const int type_override = 2;
 const int type_shockwave = 4;
-uniform int type;
+uniform int type[max_lights];
 
 vec3 lerp3(vec3 a, vec3 b, float w)
 {
@@ -47,32 +52,40 @@ void main()
 	float clip_depth = texture(depth_buffer, uv).x * 2.0 - 1.0;
 	float depth = p[3][2] / (clip_depth - p[2][2]);
 	vec3 pos = view_ray * depth;
-	vec3 to_light = light_pos - pos;
-	float distance_to_light = length(to_light);
-	to_light /= distance_to_light;
-
-	float normal_attenuation = dot(texture(normal_buffer, uv).xyz * 2.0 - 1.0, to_light);
+	vec3 normal = texture(normal_buffer, uv).xyz * 2.0 - 1.0;
 
-	float light_strength;
-	if (type == type_shockwave)
-	{
-		const float shockwave_size = 0.5f;
-		const float shockwave_multiplier = 1.0f / shockwave_size;
-		light_strength = (1.0f - step(light_radius, distance_to_light)) * (distance_to_light - (light_radius - shockwave_size)) * shockwave_multiplier;
-	}
-	else if (type == type_override)
+	vec3 result = vec3(0, 0, 0);
+	for (int i = 0; i < light_count; i++)
 	{
-		float distance_attenuation = 1.0 - (distance_to_light / light_radius);
-		if (distance_attenuation < 0.0f || normal_attenuation < 0.0f)
-			discard;
-		light_strength = 1.0f;
-	}
-	else
-	{
-		float distance_attenuation = max(0, 1.0 - (distance_to_light / light_radius));
-		light_strength = distance_attenuation * max(0, normal_attenuation);
+		vec3 to_light = light_pos[i] - pos;
+		float distance_to_light = length(to_light);
+		to_light /= distance_to_light;
+
+		float normal_attenuation = dot(normal, to_light);
+
+		float light_strength;
+		if (type[i] == type_shockwave)
+		{
+			const float shockwave_size = 0.5f;
+			const float shockwave_multiplier = 1.0f / shockwave_size;
+			light_strength = (1.0f - step(light_radius[i], distance_to_light)) * (distance_to_light - (light_radius[i] - shockwave_size)) * shockwave_multiplier;
+		}
+		else if (type[i] == type_override)
+		{
+			float distance_attenuation = 1.0 - (distance_to_light / light_radius[i]);
+			if (distance_attenuation < 0.0f || normal_attenuation < 0.0f)
+				discard;
+			light_strength = 1.0f;
+		}
+		else
+		{
+			float distance_attenuation = max(0, 1.0 - (distance_to_light / light_radius[i]));
+			light_strength = distance_attenuation * max(0, normal_attenuation);
+		}
+		// clamp each light like the blend unit would if it were drawn by itself
+		result += clamp(light_color[i] * light_strength, 0.0, 1.0);
 	}
-	out_color = vec4(light_color * light_strength, 1.0f);
+	out_color = vec4(result, 1.0f);
 }
 
 #endif
@@ -19,6 +19,7 @@ namespace AI
 {
 
 Array<b8> obstacles;
+Array<ObstacleChange> obstacle_changes;
 SyncRingBuffer<SYNC_IN_SIZE> sync_in;
 SyncRingBuffer<SYNC_OUT_SIZE> sync_out;
 b8 render_meshes_dirty;
@@ -32,9 +33,8 @@ void loop()
 
 void quit()
 {
-	sync_in.lock();
 	sync_in.write(Op::Quit);
-	sync_in.unlock();
+	sync_in.write_commit();
 }
 
 #define SENSOR_UPDATE_INTERVAL 0.5f
@@ -55,16 +55,14 @@ void update(const Update& u)
 		for (auto i = ContainmentField::list.iterator(); !i.is_last(); i.next())
 			containment_fields.add({ i.item()->get<Transform>()->absolute_pos(), i.item()->team });
 
-		sync_in.lock();
 		sync_in.write(Op::UpdateState);
 		sync_in.write(sensors.length);
 		sync_in.write(sensors.data, sensors.length);
 		sync_in.write(containment_fields.length);
 		sync_in.write(containment_fields.data, containment_fields.length);
-		sync_in.unlock();
+		sync_in.write_commit();
 	}
 
-	sync_out.lock();
 	while (sync_out.can_read())
 	{
 		Callback cb;
@@ -100,7 +98,7 @@ void update(const Update& u)
 			}
 		}
 	}
-	sync_out.unlock();
+	sync_out.read_commit();
 }
 
 b8 match(Team t, TeamMask m)
@@ -133,13 +131,12 @@ u32 obstacle_add(const Vec3& pos, r32 radius, r32 height)
 		obstacles.add(true);
 	}
 
-	sync_in.lock();
-	sync_in.write(Op::ObstacleAdd);
-	sync_in.write(id);
-	sync_in.write(pos);
-	sync_in.write(radius);
-	sync_in.write(height);
-	sync_in.unlock();
+	ObstacleChange* change = obstacle_changes.add();
+	change->pos = pos;
+	change->id = id;
+	change->radius = radius;
+	change->height = height;
+	change->add = true;
 
 	return id;
 }
@@ -147,19 +144,32 @@ u32 obstacle_add(const Vec3& pos, r32 radius, r32 height)
 void obstacle_remove(u32 id)
 {
 	obstacles[id] = false;
-	sync_in.lock();
-	sync_in.write(Op::ObstacleRemove);
-	sync_in.write(id);
-	sync_in.unlock();
+
+	ObstacleChange* change = obstacle_changes.add();
+	change->id = id;
+	change->add = false;
+}
+
+// IDs get reused, so the changes have to be applied in order
+void obstacles_flush()
+{
+	if (obstacle_changes.length == 0)
+		return;
+
+	sync_in.write(Op::ObstacleUpdate);
+	sync_in.write(obstacle_changes.length);
+	sync_in.write(obstacle_changes.data, obstacle_changes.length);
+	sync_in.write_commit();
+	obstacle_changes.length = 0;
 }
 
 void load(const u8* data, s32 length)
 {
-	sync_in.lock();
+	obstacles_flush(); // these belong to the old level
 	sync_in.write(Op::Load);
 	sync_in.write(length);
 	sync_in.write(data, length);
-	sync_in.unlock();
+	sync_in.write_commit();
 	render_meshes_dirty = true;
 }
 
@@ -168,11 +178,10 @@ u32 random_path(const Vec3& pos, const LinkEntryArg<const Result&>& callback)
 	u32 id = callback_in_id;
 	callback_in_id++;
 
-	sync_in.lock();
 	sync_in.write(Op::RandomPath);
 	sync_in.write(pos);
 	sync_in.write(callback);
-	sync_in.unlock();
+	sync_in.write_commit();
 
 	return id;
 }
@@ -187,12 +196,11 @@ u32 pathfind(const Vec3& a, const Vec3& b, const LinkEntryArg<const Result&>& ca
 	u32 id = callback_in_id;
 	callback_in_id++;
 
-	sync_in.lock();
 	sync_in.write(Op::Pathfind);
 	sync_in.write(a);
 	sync_in.write(b);
 	sync_in.write(callback);
-	sync_in.unlock();
+	sync_in.write_commit();
 
 	return id;
 }
@@ -202,7 +210,6 @@ u32 awk_pathfind(AwkPathfind type, AwkAllow rule, Team team, const Vec3& a, cons
 	u32 id = callback_in_id;
 	callback_in_id++;
 
-	sync_in.lock();
 	sync_in.write(Op::AwkPathfind);
 	sync_in.write(type);
 	sync_in.write(rule);
@@ -216,18 +223,17 @@ u32 awk_pathfind(AwkPathfind type, AwkAllow rule, Team team, const Vec3& a, cons
 		if (type != AwkPathfind::Target)
 			sync_in.write(b_normal);
 	}
-	sync_in.unlock();
+	sync_in.write_commit();
 	
 	return id;
 }
 
 void awk_mark_adjacency_bad(AwkNavMeshNode a, AwkNavMeshNode b)
 {
-	sync_in.lock();
 	sync_in.write(Op::AwkMarkAdjacencyBad);
 	sync_in.write(a);
 	sync_in.write(b);
-	sync_in.unlock();
+	sync_in.write_commit();
 }
 
 #if DEBUG
@@ -239,7 +245,7 @@ void refresh_nav_render_meshes(const RenderParams& params)
 		return;
 
 	std::this_thread::sleep_for(std::chrono::milliseconds(30));
-	sync_in.lock();
+	std::lock_guard<std::mutex> lock(Worker::mutex);
 
 	if (render_mesh == AssetNull)
 	{
@@ -345,8 +351,6 @@ void refresh_nav_render_meshes(const RenderParams& params)
 		params.sync->write<s32>(indices.data, indices.length);
 	}
 
-	sync_in.unlock();
-
 	render_meshes_dirty = false;
 }
 
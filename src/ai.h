@@ -23,8 +23,7 @@ namespace AI
 	enum class Op
 	{
 		Load,
-		ObstacleAdd,
-		ObstacleRemove,
+		ObstacleUpdate,
 		Pathfind,
 		AwkPathfind,
 		AwkMarkAdjacencyBad,
@@ -91,6 +90,16 @@ namespace AI
 
 	typedef SensorState ContainmentFieldState;
 
+	// obstacle adds and removes are queued up and sent to the worker together, once per frame
+	struct ObstacleChange
+	{
+		Vec3 pos;
+		u32 id;
+		r32 radius;
+		r32 height;
+		b8 add;
+	};
+
 	static const s32 SYNC_IN_SIZE = 6 * 1024 * 1024;
 	static const s32 SYNC_OUT_SIZE = 1 * 1024 * 1024;
 	extern Array<b8> obstacles;
@@ -102,6 +111,7 @@ namespace AI
 	b8 match(AI::Team, AI::TeamMask);
 	u32 obstacle_add(const Vec3&, r32, r32);
 	void obstacle_remove(u32);
+	void obstacles_flush();
 	u32 pathfind(const Vec3&, const Vec3&, const LinkEntryArg<const Result&>&);
 	u32 awk_pathfind(AwkPathfind, AwkAllow, AI::Team, const Vec3&, const Vec3&, const Vec3&, const Vec3&, const LinkEntryArg<const AwkResult&>&);
 	void awk_mark_adjacency_bad(AwkNavMeshNode, AwkNavMeshNode);
@@ -123,31 +133,57 @@ namespace AI
 			void process(struct dtNavMeshCreateParams* params, u8* polyAreas, u16* polyFlags);
 		};
 
-		struct AwkNavMeshNodeData
-		{
-			r32 travel_score;
-			r32 estimate_score;
-			r32 sensor_score;
-			AwkNavMeshNode parent;
-			b8 visited;
-			b8 in_queue;
-			b8 crawled_from_parent;
-		};
-
+		// A* scratch data, stored as flat structure-of-arrays indexed by vertex across all chunks.
+		// every search stamps the nodes it touches with the current generation,
+		// so starting a new search doesn't require clearing anything.
 		struct AwkNavMeshKey
 		{
-			Chunks<Array<AwkNavMeshNodeData>> data;
-			r32 priority(const AwkNavMeshNode&);
+			enum Flag
+			{
+				FlagVisited = 1 << 0,
+				FlagInQueue = 1 << 1,
+				FlagCrawledFromParent = 1 << 2,
+			};
+
+			Array<s32> chunk_offsets;
+			Array<r32> travel_score;
+			Array<r32> estimate_score;
+			Array<r32> sensor_score;
+			Array<AwkNavMeshNode> parent;
+			Array<u16> generation;
+			Array<u8> flags;
+			u16 current_generation;
+
+			AwkNavMeshKey();
+			r32 priority(const AwkNavMeshNode&) const;
 			void resize(const AwkNavMesh&);
 			void reset();
-			AwkNavMeshNodeData& get(const AwkNavMeshNode&);
+			s32 touch(const AwkNavMeshNode&);
+
+			inline s32 index(const AwkNavMeshNode& node) const
+			{
+				return chunk_offsets[node.chunk] + node.vertex;
+			}
+
+			inline b8 flag(s32 index, Flag f) const
+			{
+				return flags[index] & f;
+			}
+
+			inline void flag(s32 index, Flag f, b8 value)
+			{
+				if (value)
+					flags[index] |= f;
+				else
+					flags[index] &= ~f;
+			}
 		};
 
 		const extern r32 default_search_extents[];
 
+		extern std::mutex mutex; // held while the dispatcher processes an op
 		extern dtNavMesh* nav_mesh;
 		extern AwkNavMesh awk_nav_mesh;
-		extern AwkNavMeshKey awk_nav_mesh_key;
 		extern dtNavMeshQuery* nav_mesh_query;
 		extern dtTileCache* nav_tile_cache;
 		extern dtQueryFilter default_query_filter;
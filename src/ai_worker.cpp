@@ -5,10 +5,13 @@
 #include "recast/Detour/Include/DetourCommon.h"
 #include "data/priority_queue.h"
 #include "mersenne/mersenne-twister.h"
+#include <thread>
 
 #define DEBUG_AI 0
+#define DEBUG_AI_BENCHMARK 0 // time a batch of Awk searches every time a level loads
+#define BENCHMARK_SEARCHES 256
 
-#if DEBUG_AI
+#if DEBUG_AI || DEBUG_AI_BENCHMARK
 #include "platform/util.h"
 #endif
 
@@ -22,23 +25,75 @@ namespace Worker
 {
 
 
+#define WORKERS_MAX 8
+
+std::mutex mutex;
 dtNavMesh* nav_mesh = nullptr;
 AwkNavMesh awk_nav_mesh;
-AwkNavMeshKey awk_nav_mesh_key;
-PriorityQueue<AwkNavMeshNode, AwkNavMeshKey> astar_queue(&awk_nav_mesh_key);
+s32 nav_epoch; // incremented every time the nav meshes are loaded
 dtTileCache* nav_tile_cache = nullptr;
 dtTileCacheAlloc nav_tile_allocator;
 FastLZCompressor nav_tile_compressor;
 NavMeshProcess nav_tile_mesh_process;
-dtNavMeshQuery* nav_mesh_query = nullptr;
+dtNavMeshQuery* nav_mesh_query = nullptr; // dispatcher only
 dtQueryFilter default_query_filter = dtQueryFilter();
 const r32 default_search_extents[] = { 15, 30, 15 };
 
-dtPolyRef get_poly(const Vec3& pos, const r32* search_extents)
+#define CHUNK_INDEX_PADDING 1.0f // slack for vertices sitting right on a chunk boundary
+
+// sensors or containment fields bucketed by the awk nav mesh chunks they overlap,
+// so cost functions only look at nearby ones.
+// entries for chunk i are refs[offsets[i]] through refs[offsets[i + 1] - 1].
+// one extra bucket at the end holds everything, for queries outside the nav mesh.
+struct ChunkIndex
+{
+	Array<s32> offsets;
+	Array<u16> refs;
+
+	void build(const AwkNavMesh&, const Array<SensorState>&, r32);
+	void copy(const ChunkIndex&);
+
+	inline s32 bucket(s32 chunk) const
+	{
+		return chunk == -1 ? offsets.length - 2 : chunk;
+	}
+};
+
+// latest sensor and containment field state from the game thread.
+// pathfinding threads copy it at the start of a job whenever state_epoch has moved on.
+std::mutex state_mutex;
+s32 state_epoch;
+Array<SensorState> sensors;
+Array<ContainmentFieldState> containment_fields;
+ChunkIndex sensor_index;
+ChunkIndex containment_field_index;
+
+// scratch space for one pathfinding thread.
+// the nav meshes themselves are shared, and nothing modifies them while jobs are running.
+struct Context
+{
+	AwkNavMeshKey key;
+	PriorityQueue<AwkNavMeshNode, AwkNavMeshKey> astar_queue;
+	dtNavMeshQuery* nav_mesh_query;
+	Array<SensorState> sensors;
+	Array<ContainmentFieldState> containment_fields;
+	ChunkIndex sensor_index;
+	ChunkIndex containment_field_index;
+	s32 detour_epoch; // nav_epoch as of the last time we set up the detour query
+	s32 awk_epoch; // nav_epoch as of the last time we sized the A* scratch
+	s32 state_epoch;
+
+	Context()
+		: key(), astar_queue(&key), nav_mesh_query(), sensors(), containment_fields(), sensor_index(), containment_field_index(), detour_epoch(-1), awk_epoch(-1), state_epoch(-1)
+	{
+	}
+};
+
+dtPolyRef get_poly(dtNavMeshQuery* query, const Vec3& pos, const r32* search_extents)
 {
 	dtPolyRef result;
 
-	nav_mesh_query->findNearestPoly((r32*)&pos, search_extents, &default_query_filter, &result, 0);
+	query->findNearestPoly((r32*)&pos, search_extents, &default_query_filter, &result, 0);
 
 	return result;
 }
@@ -48,7 +103,7 @@ struct AstarScorer
 	// calculate heuristic score for nav mesh vertex
 	virtual r32 score(const Vec3&) = 0;
 	// did we find what we're looking for?
-	virtual b8 done(AwkNavMeshNode, const AwkNavMeshNodeData&) = 0;
+	virtual b8 done(AwkNavMeshNode, r32 sensor_score) = 0;
 };
 
 // pathfind to a target vertex
@@ -62,7 +117,7 @@ struct PathfindScorer : AstarScorer
 		return (end_pos - pos).length();
 	}
 
-	virtual b8 done(AwkNavMeshNode v, const AwkNavMeshNodeData&)
+	virtual b8 done(AwkNavMeshNode v, r32)
 	{
 		return v.equals(end_vertex);
 	}
@@ -82,12 +137,12 @@ struct AwayScorer : AstarScorer
 		return vi_max(0.0f, minimum_distance - (away_pos - pos).length());
 	}
 
-	virtual b8 done(AwkNavMeshNode v, const AwkNavMeshNodeData& data)
+	virtual b8 done(AwkNavMeshNode v, r32 sensor_score)
 	{
 		if (v.equals(start_vertex)) // we need to go somewhere other than here
 			return false;
 
-		if (data.sensor_score <= 8.0f) // inside a friendly sensor zone or containment field
+		if (sensor_score <= 8.0f) // inside a friendly sensor zone or containment field
 			return true;
 
 		const Vec3& vertex = awk_nav_mesh.chunks[v.chunk].vertices[v.vertex];
@@ -116,23 +171,121 @@ struct RandomScorer : AstarScorer
 		return (goal - pos).length();
 	}
 
-	virtual b8 done(AwkNavMeshNode v, const AwkNavMeshNodeData& data)
+	virtual b8 done(AwkNavMeshNode v, r32)
 	{
 		return awk_nav_mesh.chunks[v.chunk].adjacency[v.vertex].neighbors.length == AWK_NAV_MESH_ADJACENCY // end goal must be a highly accessible location
 			&& (start_pos - awk_nav_mesh.chunks[v.chunk].vertices[v.vertex]).length_squared() > (minimum_distance * minimum_distance);
 	}
 };
 
-Array<SensorState> sensors;
-Array<ContainmentFieldState> containment_fields;
+void ChunkIndex::build(const AwkNavMesh& mesh, const Array<SensorState>& items, r32 radius)
+{
+	s32 chunk_count = mesh.chunks.length;
+	offsets.resize(chunk_count + 2);
+	memset(offsets.data, 0, sizeof(s32) * offsets.length);
+
+	// count, then fill
+	Array<s32> cursor(offsets.length, offsets.length);
+	for (s32 pass = 0; pass < 2; pass++)
+	{
+		for (s32 i = 0; i < items.length && chunk_count > 0; i++)
+		{
+			const Vec3& pos = items[i].pos;
+			Vec3 padding(radius + CHUNK_INDEX_PADDING);
+			AwkNavMesh::Coord min = mesh.clamped_coord(mesh.coord(pos - padding));
+			AwkNavMesh::Coord max = mesh.clamped_coord(mesh.coord(pos + padding));
+			for (s32 x = min.x; x <= max.x; x++)
+			{
+				for (s32 y = min.y; y <= max.y; y++)
+				{
+					for (s32 z = min.z; z <= max.z; z++)
+					{
+						// sphere vs. padded chunk bounds
+						Vec3 chunk_min = mesh.vmin + Vec3(r32(x), r32(y), r32(z)) * mesh.chunk_size - Vec3(CHUNK_INDEX_PADDING);
+						Vec3 chunk_max = chunk_min + Vec3(mesh.chunk_size + CHUNK_INDEX_PADDING * 2.0f);
+						Vec3 closest
+						(
+							vi_max(chunk_min.x, vi_min(pos.x, chunk_max.x)),
+							vi_max(chunk_min.y, vi_min(pos.y, chunk_max.y)),
+							vi_max(chunk_min.z, vi_min(pos.z, chunk_max.z))
+						);
+						if ((closest - pos).length_squared() < radius * radius)
+						{
+							s32 chunk = mesh.index({ x, y, z });
+							if (pass == 0)
+								offsets[chunk + 1]++;
+							else
+							{
+								refs[cursor[chunk]] = u16(i);
+								cursor[chunk]++;
+							}
+						}
+					}
+				}
+			}
+		}
+
+		// catch-all bucket
+		for (s32 i = 0; i < items.length; i++)
+		{
+			if (pass == 0)
+				offsets[chunk_count + 1]++;
+			else
+			{
+				refs[cursor[chunk_count]] = u16(i);
+				cursor[chunk_count]++;
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (s32 i = 1; i < offsets.length; i++)
+				offsets[i] += offsets[i - 1];
+			refs.resize(offsets[offsets.length - 1]);
+			memcpy(cursor.data, offsets.data, sizeof(s32) * offsets.length);
+		}
+	}
+}
+
+void ChunkIndex::copy(const ChunkIndex& other)
+{
+	offsets.resize(other.offsets.length);
+	memcpy(offsets.data, other.offsets.data, sizeof(s32) * other.offsets.length);
+	refs.resize(other.refs.length);
+	memcpy(refs.data, other.refs.data, sizeof(u16) * other.refs.length);
+}
+
+// rebuild the chunk indices and hand the new state out to the pathfinding threads.
+// state_mutex must be locked.
+void state_publish()
+{
+	sensor_index.build(awk_nav_mesh, sensors, SENSOR_RANGE);
+	containment_field_index.build(awk_nav_mesh, containment_fields, CONTAINMENT_FIELD_RADIUS);
+	state_epoch++;
+}
+
+// index of the chunk containing the given point, or -1 if it's outside the nav mesh
+s32 chunk_containing(const Vec3& pos)
+{
+	if (awk_nav_mesh.chunks.length == 0)
+		return -1;
+	Vec3 p = (pos - awk_nav_mesh.vmin) / awk_nav_mesh.chunk_size;
+	AwkNavMesh::Coord c = { s32(floorf(p.x)), s32(floorf(p.y)), s32(floorf(p.z)) };
+	if (awk_nav_mesh.contains(c))
+		return awk_nav_mesh.index(c);
+	return -1;
+}
 
 // describes which enemy containment fields you are currently inside
-u32 containment_field_hash(Team my_team, const Vec3& pos)
+u32 containment_field_hash(const Context* context, Team my_team, const Vec3& pos, s32 chunk)
 {
+	const ChunkIndex& index = context->containment_field_index;
+	s32 bucket = index.bucket(chunk);
 	u32 result = 0;
-	for (s32 i = 0; i < containment_fields.length; i++)
+	for (s32 j = index.offsets[bucket]; j < index.offsets[bucket + 1]; j++)
 	{
-		const ContainmentFieldState& field = containment_fields[i];
+		s32 i = index.refs[j];
+		const ContainmentFieldState& field = context->containment_fields[i];
 		if (field.team != my_team && (pos - field.pos).length_squared() < CONTAINMENT_FIELD_RADIUS * CONTAINMENT_FIELD_RADIUS)
 		{
 			if (result == 0)
@@ -143,25 +296,62 @@ u32 containment_field_hash(Team my_team, const Vec3& pos)
 	return result;
 }
 
-b8 containment_field_raycast(Team my_team, const Vec3& a, const Vec3& b)
+u32 containment_field_hash(const Context* context, Team my_team, const Vec3& pos)
+{
+	return containment_field_hash(context, my_team, pos, chunk_containing(pos));
+}
+
+b8 containment_field_raycast_bucket(const Context* context, Team my_team, const Vec3& a, const Vec3& b, s32 bucket)
 {
-	for (s32 i = 0; i < containment_fields.length; i++)
+	const ChunkIndex& index = context->containment_field_index;
+	for (s32 j = index.offsets[bucket]; j < index.offsets[bucket + 1]; j++)
 	{
-		const ContainmentFieldState& field = containment_fields[i];
+		const ContainmentFieldState& field = context->containment_fields[index.refs[j]];
 		if (field.team != my_team && LMath::ray_sphere_intersect(a, b, field.pos, CONTAINMENT_FIELD_RADIUS))
 			return true;
 	}
 	return false;
 }
 
-r32 sensor_cost(Team team, const AwkNavMeshNode& node)
+b8 containment_field_raycast(const Context* context, Team my_team, const Vec3& a, const Vec3& b)
+{
+	if (context->containment_fields.length == 0)
+		return false;
+
+	s32 chunk_a = chunk_containing(a);
+	s32 chunk_b = chunk_containing(b);
+	if (chunk_a == -1 || chunk_b == -1)
+		return containment_field_raycast_bucket(context, my_team, a, b, context->containment_field_index.bucket(-1));
+
+	// any field the segment hits overlaps one of the chunks in the segment's bounding box
+	AwkNavMesh::Coord coord_a = awk_nav_mesh.coord(chunk_a);
+	AwkNavMesh::Coord coord_b = awk_nav_mesh.coord(chunk_b);
+	for (s32 x = vi_min(coord_a.x, coord_b.x); x <= vi_max(coord_a.x, coord_b.x); x++)
+	{
+		for (s32 y = vi_min(coord_a.y, coord_b.y); y <= vi_max(coord_a.y, coord_b.y); y++)
+		{
+			for (s32 z = vi_min(coord_a.z, coord_b.z); z <= vi_max(coord_a.z, coord_b.z); z++)
+			{
+				if (containment_field_raycast_bucket(context, my_team, a, b, awk_nav_mesh.index({ x, y, z })))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+r32 sensor_cost(const Context* context, Team team, const AwkNavMeshNode& node)
 {
+	const Array<SensorState>& sensors = context->sensors;
+	const Array<ContainmentFieldState>& containment_fields = context->containment_fields;
+	const ChunkIndex& index = context->sensor_index;
 	const Vec3& pos = awk_nav_mesh.chunks[node.chunk].vertices[node.vertex];
 	const Vec3& normal = awk_nav_mesh.chunks[node.chunk].normals[node.vertex];
 	b8 in_friendly_zone = false;
 	b8 in_enemy_zone = false;
-	for (s32 i = 0; i < sensors.length; i++)
+	for (s32 j = index.offsets[node.chunk]; j < index.offsets[node.chunk + 1]; j++)
 	{
+		s32 i = index.refs[j];
 		Vec3 to_sensor = sensors[i].pos - pos;
 		if (to_sensor.length_squared() < SENSOR_RANGE * SENSOR_RANGE)
 		{
@@ -189,9 +379,10 @@ r32 sensor_cost(Team team, const AwkNavMeshNode& node)
 
 	r32 containment_field_cost = 8.0f;
 
-	for (s32 i = 0; i < containment_fields.length; i++)
+	const ChunkIndex& field_index = context->containment_field_index;
+	for (s32 j = field_index.offsets[node.chunk]; j < field_index.offsets[node.chunk + 1]; j++)
 	{
-		const ContainmentFieldState& field = containment_fields[i];
+		const ContainmentFieldState& field = containment_fields[field_index.refs[j]];
 		if (field.team == team)
 		{
 			Vec3 to_field = field.pos - pos;
@@ -206,14 +397,14 @@ r32 sensor_cost(Team team, const AwkNavMeshNode& node)
 	return sensor_cost + containment_field_cost;
 }
 
-AwkNavMeshNode awk_closest_point(Team team, const Vec3& p, const Vec3& normal)
+AwkNavMeshNode awk_closest_point(const Context* context, Team team, const Vec3& p, const Vec3& normal)
 {
 	AwkNavMesh::Coord chunk_coord = awk_nav_mesh.coord(p);
 	r32 closest_distance = FLT_MAX;
 	b8 found = false;
 	AwkNavMeshNode closest = AWK_NAV_MESH_NODE_NONE;
 	b8 ignore_normals = normal.dot(normal) == 0.0f;
-	u32 desired_hash = containment_field_hash(team, p);
+	u32 desired_hash = containment_field_hash(context, team, p);
 	s32 end_x = vi_min(vi_max(chunk_coord.x + 2, 1), awk_nav_mesh.size.x);
 	for (s32 chunk_x = vi_min(vi_max(chunk_coord.x - 1, 0), awk_nav_mesh.size.x - 1); chunk_x < end_x; chunk_x++)
 	{
@@ -237,7 +428,7 @@ AwkNavMeshNode awk_closest_point(Team team, const Vec3& p, const Vec3& normal)
 						{
 							r32 distance = to_vertex.length_squared();
 							if (distance < closest_distance
-								&& containment_field_hash(team, vertex) == desired_hash)
+								&& containment_field_hash(context, team, vertex, chunk_index) == desired_hash)
 							{
 								const Vec3& vertex_normal = chunk.normals[vertex_index];
 								if (ignore_normals || normal.dot(vertex_normal) > 0.8f) // make sure it's roughly facing the right way
@@ -304,7 +495,7 @@ inline b8 awk_flags_match(b8 flags, AwkAllow mask)
 }
 
 // A*
-void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, AstarScorer* scorer, AwkPath* path)
+void awk_astar(Context* context, AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, AstarScorer* scorer, AwkPath* path)
 {
 	path->length = 0;
 
@@ -317,39 +508,40 @@ void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, Ast
 
 	const Vec3& start_pos = awk_nav_mesh.chunks[start_vertex.chunk].vertices[start_vertex.vertex];
 
-	u32 start_field_hash = containment_field_hash(team, start_pos);
+	u32 start_field_hash = containment_field_hash(context, team, start_pos);
 
-	awk_nav_mesh_key.reset();
+	AwkNavMeshKey& key = context->key;
+	PriorityQueue<AwkNavMeshNode, AwkNavMeshKey>& astar_queue = context->astar_queue;
+	key.reset();
 	astar_queue.clear();
-	astar_queue.push(start_vertex);
 
 	{
-		AwkNavMeshNodeData* start_data = &awk_nav_mesh_key.get(start_vertex);
-		start_data->travel_score = 0;
-		start_data->estimate_score = scorer->score(start_pos);
-		start_data->sensor_score = sensor_cost(team, start_vertex);
-		start_data->parent = AWK_NAV_MESH_NODE_NONE;
-		start_data->crawled_from_parent = true;
-		start_data->in_queue = true;
-		start_data->visited = false;
+		s32 start = key.touch(start_vertex);
+		key.travel_score[start] = 0;
+		key.estimate_score[start] = scorer->score(start_pos);
+		key.sensor_score[start] = sensor_cost(context, team, start_vertex);
+		key.parent[start] = AWK_NAV_MESH_NODE_NONE;
+		key.flag(start, AwkNavMeshKey::FlagCrawledFromParent, true);
+		key.flag(start, AwkNavMeshKey::FlagInQueue, true);
 
 #if DEBUG_AI
-		vi_debug("estimate: %f - %s", start_data->estimate_score, typeid(*scorer).name());
+		vi_debug("estimate: %f - %s", key.estimate_score[start], typeid(*scorer).name());
 #endif
 	}
+	astar_queue.push(start_vertex);
 
 	while (astar_queue.size() > 0)
 	{
 		AwkNavMeshNode vertex_node = astar_queue.pop();
 
-		AwkNavMeshNodeData* vertex_data = &awk_nav_mesh_key.get(vertex_node);
+		s32 vertex = key.index(vertex_node);
 
-		vertex_data->visited = true;
-		vertex_data->in_queue = false;
+		key.flag(vertex, AwkNavMeshKey::FlagVisited, true);
+		key.flag(vertex, AwkNavMeshKey::FlagInQueue, false);
 
 		const Vec3& vertex_pos = awk_nav_mesh.chunks[vertex_node.chunk].vertices[vertex_node.vertex];
 
-		if (scorer->done(vertex_node, *vertex_data))
+		if (scorer->done(vertex_node, key.sensor_score[vertex]))
 		{
 			// reconstruct path
 			AwkNavMeshNode n = vertex_node;
@@ -357,18 +549,18 @@ void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, Ast
 			{
 				if (path->length == path->capacity())
 					path->remove(path->length - 1);
-				const AwkNavMeshNodeData& data = awk_nav_mesh_key.get(n);
+				s32 n_index = key.index(n);
 				AwkPathNode* node = path->insert(0);
 				*node =
 				{
 					awk_nav_mesh.chunks[n.chunk].vertices[n.vertex],
 					awk_nav_mesh.chunks[n.chunk].normals[n.vertex],
 					n,
-					data.crawled_from_parent, // crawl flag
+					key.flag(n_index, AwkNavMeshKey::FlagCrawledFromParent), // crawl flag
 				};
 				if (n.equals(start_vertex))
 					break;
-				n = data.parent;
+				n = key.parent[n_index];
 			}
 			break; // done!
 		}
@@ -378,38 +570,38 @@ void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, Ast
 		{
 			// visit neighbors
 			const AwkNavMeshNode adjacent_node = adjacency.neighbors[i];
-			AwkNavMeshNodeData* adjacent_data = &awk_nav_mesh_key.get(adjacent_node);
+			s32 adjacent = key.touch(adjacent_node);
 
-			if (!adjacent_data->visited)
+			if (!key.flag(adjacent, AwkNavMeshKey::FlagVisited))
 			{
 				// hasn't been visited yet
 
 				const Vec3& adjacent_pos = awk_nav_mesh.chunks[adjacent_node.chunk].vertices[adjacent_node.vertex];
 
 				if (!awk_flags_match(adjacency.flag(i), rule)
-					|| containment_field_raycast(team, vertex_pos, adjacent_pos))
+					|| containment_field_raycast(context, team, vertex_pos, adjacent_pos))
 				{
 					// flags don't match or it's in a different containment field
 					// therefore it's unreachable
-					adjacent_data->visited = true;
+					key.flag(adjacent, AwkNavMeshKey::FlagVisited, true);
 				}
 				else
 				{
-					r32 candidate_travel_score = vertex_data->travel_score
-						+ vertex_data->sensor_score
+					r32 candidate_travel_score = key.travel_score[vertex]
+						+ key.sensor_score[vertex]
 						+ (adjacent_pos - vertex_pos).length()
 						+ 4.0f; // bias toward longer shots
 
-					if (adjacent_data->in_queue)
+					if (key.flag(adjacent, AwkNavMeshKey::FlagInQueue))
 					{
 						// it's already in the queue
-						if (candidate_travel_score < adjacent_data->travel_score)
+						if (candidate_travel_score < key.travel_score[adjacent])
 						{
 							// this is a better path
 
-							adjacent_data->crawled_from_parent = adjacency.flag(i);
-							adjacent_data->parent = vertex_node;
-							adjacent_data->travel_score = candidate_travel_score;
+							key.flag(adjacent, AwkNavMeshKey::FlagCrawledFromParent, adjacency.flag(i));
+							key.parent[adjacent] = vertex_node;
+							key.travel_score[adjacent] = candidate_travel_score;
 
 							// update its position in the queue due to the score change
 							for (s32 j = 0; j < astar_queue.size(); j++)
@@ -425,12 +617,12 @@ void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, Ast
 					else
 					{
 						// totally new node, not in queue yet
-						adjacent_data->crawled_from_parent = adjacency.flag(i);
-						adjacent_data->parent = vertex_node;
-						adjacent_data->sensor_score = sensor_cost(team, adjacent_node);
-						adjacent_data->travel_score = candidate_travel_score;
-						adjacent_data->estimate_score = scorer->score(adjacent_pos);
-						adjacent_data->in_queue = true;
+						key.flag(adjacent, AwkNavMeshKey::FlagCrawledFromParent, adjacency.flag(i));
+						key.parent[adjacent] = vertex_node;
+						key.sensor_score[adjacent] = sensor_cost(context, team, adjacent_node);
+						key.travel_score[adjacent] = candidate_travel_score;
+						key.estimate_score[adjacent] = scorer->score(adjacent_pos);
+						key.flag(adjacent, AwkNavMeshKey::FlagInQueue, true);
 						astar_queue.push(adjacent_node);
 					}
 				}
@@ -443,7 +635,7 @@ void awk_astar(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, Ast
 }
 
 // find a path from vertex a to vertex b
-void awk_pathfind_internal(AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, const AwkNavMeshNode& end_vertex, AwkPath* path)
+void awk_pathfind_internal(Context* context, AwkAllow rule, Team team, const AwkNavMeshNode& start_vertex, const AwkNavMeshNode& end_vertex, AwkPath* path)
 {
 	path->length = 0;
 	if (start_vertex.equals(AWK_NAV_MESH_NODE_NONE) || end_vertex.equals(AWK_NAV_MESH_NODE_NONE))
@@ -452,25 +644,25 @@ void awk_pathfind_internal(AwkAllow rule, Team team, const AwkNavMeshNode& start
 	scorer.end_vertex = end_vertex;
 	scorer.end_pos = awk_nav_mesh.chunks[end_vertex.chunk].vertices[end_vertex.vertex];
 	const Vec3& start_pos = awk_nav_mesh.chunks[start_vertex.chunk].vertices[start_vertex.vertex];
-	if (containment_field_hash(team, start_pos) != containment_field_hash(team, scorer.end_pos))
+	if (containment_field_hash(context, team, start_pos) != containment_field_hash(context, team, scorer.end_pos))
 		return; // in a different containment field; unreachable
 	else
-		awk_astar(rule, team, start_vertex, &scorer, path);
+		awk_astar(context, rule, team, start_vertex, &scorer, path);
 }
 
 // find a path using vertices as close as possible to the given points
 // find our way to a point from which we can shoot through the given target
-void awk_pathfind_hit(AwkAllow rule, Team team, const Vec3& start, const Vec3& start_normal, const Vec3& target, AwkPath* path)
+void awk_pathfind_hit(Context* context, AwkAllow rule, Team team, const Vec3& start, const Vec3& start_normal, const Vec3& target, AwkPath* path)
 {
 	path->length = 0;
-	if (containment_field_hash(team, start) != containment_field_hash(team, target))
+	if (containment_field_hash(context, team, start) != containment_field_hash(context, team, target))
 		return; // in a different containment field; unreachable
 
-	AwkNavMeshNode target_closest_vertex = awk_closest_point(team, target, Vec3::zero);
+	AwkNavMeshNode target_closest_vertex = awk_closest_point(context, team, target, Vec3::zero);
 	if (target_closest_vertex.equals(AWK_NAV_MESH_NODE_NONE))
 		return;
 
-	AwkNavMeshNode start_vertex = awk_closest_point(team, start, start_normal);
+	AwkNavMeshNode start_vertex = awk_closest_point(context, team, start, start_normal);
 	if (start_vertex.equals(AWK_NAV_MESH_NODE_NONE))
 		return;
 
@@ -481,7 +673,7 @@ void awk_pathfind_hit(AwkAllow rule, Team team, const Vec3& start, const Vec3& s
 	// this prevents us from getting stuck at a point where we think we should be able to hit the target, but we actually can't
 
 	if (!target_closest_vertex.equals(start_vertex) && can_hit_from(target_closest_vertex, target, 0.999f))
-		awk_pathfind_internal(rule, team, start_vertex, target_closest_vertex, path);
+		awk_pathfind_internal(context, rule, team, start_vertex, target_closest_vertex, path);
 	else
 	{
 		const AwkNavMeshAdjacency& target_adjacency = awk_nav_mesh.chunks[target_closest_vertex.chunk].adjacency[target_closest_vertex.vertex];
@@ -509,7 +701,7 @@ void awk_pathfind_hit(AwkAllow rule, Team team, const Vec3& start, const Vec3& s
 			path->length = 0; // can't find a path to hit this thing
 		else
 		{
-			awk_pathfind_internal(rule, team, start_vertex, closest_vertex, path);
+			awk_pathfind_internal(context, rule, team, start_vertex, closest_vertex, path);
 			if (path->length > 0 && path->length < path->capacity())
 			{
 				AwkPathNode* node = path->add();
@@ -531,7 +723,7 @@ void NavMeshProcess::process(struct dtNavMeshCreateParams* params, u8* polyAreas
 		polyFlags[i] = 1;
 }
 
-void pathfind(const Vec3& a, const Vec3& b, dtPolyRef start_poly, dtPolyRef end_poly, Path* path)
+void pathfind(dtNavMeshQuery* query, const Vec3& a, const Vec3& b, dtPolyRef start_poly, dtPolyRef end_poly, Path* path)
 {
 	dtPolyRef path_polys[MAX_PATH_LENGTH];
 	dtPolyRef path_parents[MAX_PATH_LENGTH];
@@ -539,7 +731,7 @@ void pathfind(const Vec3& a, const Vec3& b, dtPolyRef start_poly, dtPolyRef end_
 	dtPolyRef path_straight_polys[MAX_PATH_LENGTH];
 	s32 path_poly_count;
 
-	nav_mesh_query->findPath(start_poly, end_poly, (r32*)&a, (r32*)&b, &default_query_filter, path_polys, &path_poly_count, MAX_PATH_LENGTH);
+	query->findPath(start_poly, end_poly, (r32*)&a, (r32*)&b, &default_query_filter, path_polys, &path_poly_count, MAX_PATH_LENGTH);
 	if (path_poly_count == 0)
 		path->length = 0;
 	else
@@ -549,13 +741,13 @@ void pathfind(const Vec3& a, const Vec3& b, dtPolyRef start_poly, dtPolyRef end_
 		if (path_polys[path_poly_count - 1] == end_poly)
 			end = b;
 		else
-			nav_mesh_query->closestPointOnPoly(path_polys[path_poly_count - 1], (r32*)&b, (r32*)&end, 0);
+			query->closestPointOnPoly(path_polys[path_poly_count - 1], (r32*)&b, (r32*)&end, 0);
 
 		Vec3 start;
-		nav_mesh_query->closestPointOnPoly(path_polys[0], (r32*)&a, (r32*)&start, 0);
+		query->closestPointOnPoly(path_polys[0], (r32*)&a, (r32*)&start, 0);
 
 		s32 path_length;
-		nav_mesh_query->findStraightPath
+		query->findStraightPath
 		(
 			(const r32*)&a, (const r32*)&end, path_polys, path_poly_count,
 			(r32*)path->data, path_straight_flags,
@@ -568,6 +760,308 @@ void pathfind(const Vec3& a, const Vec3& b, dtPolyRef start_poly, dtPolyRef end_
 	}
 }
 
+struct Job
+{
+	Op op;
+	AwkPathfind type;
+	AwkAllow rule;
+	Team team;
+	Vec3 a;
+	Vec3 a_normal;
+	Vec3 b;
+	Vec3 b_normal;
+	dtPolyRef b_poly;
+	LinkEntryArg<Path> callback;
+	LinkEntryArg<AwkPath> awk_callback;
+};
+
+// pathfinding requests are handed out to a pool of threads.
+// results come back in the order jobs finish, not the order they were requested.
+// every request carries its own callback, so nothing on the game side depends on the order.
+//
+// each job reads exactly one of the two nav meshes. an op which modifies a mesh blocks new jobs
+// on that mesh from starting and waits for the ones already running on it, then lets them go again.
+// jobs on the other mesh keep running the whole time, and queued jobs aren't waited on.
+enum class JobMesh
+{
+	Detour,
+	Awk,
+	count,
+};
+
+std::mutex job_mutex;
+std::condition_variable job_condition; // signaled when a job is queued, or a mesh modification finishes
+std::condition_variable idle_condition; // signaled when the last running job on a mesh finishes
+Array<Job> jobs;
+s32 job_read;
+s32 jobs_running[(s32)JobMesh::count];
+b8 mesh_writing[(s32)JobMesh::count];
+b8 jobs_quit;
+std::mutex out_mutex; // sync_out expects a single producer
+Context contexts[WORKERS_MAX];
+
+JobMesh job_mesh(Op op)
+{
+	return op == Op::AwkPathfind ? JobMesh::Awk : JobMesh::Detour;
+}
+
+void job_add(const Job& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		jobs.add(job);
+	}
+	job_condition.notify_one();
+}
+
+// block until no job is running on the given mesh, and keep new ones from starting until mesh_write_end
+void mesh_write_begin(JobMesh mesh)
+{
+	std::unique_lock<std::mutex> lock(job_mutex);
+	mesh_writing[(s32)mesh] = true;
+	while (jobs_running[(s32)mesh] > 0)
+		idle_condition.wait(lock);
+}
+
+void mesh_write_end(JobMesh mesh)
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		mesh_writing[(s32)mesh] = false;
+	}
+	job_condition.notify_all();
+}
+
+// bring the context up to date with the latest version of the job's nav mesh and game state.
+// only the job's own mesh is touched; the other one might be in the middle of being modified.
+void context_refresh(Context* context, JobMesh mesh)
+{
+	if (mesh == JobMesh::Awk && context->awk_epoch != nav_epoch)
+	{
+		context->awk_epoch = nav_epoch;
+		context->key.~AwkNavMeshKey();
+		new (&context->key) AwkNavMeshKey();
+		context->key.resize(awk_nav_mesh);
+
+		// reserve space in the A* queue
+		s32 vertex_count = 0;
+		for (s32 i = 0; i < awk_nav_mesh.chunks.length; i++)
+			vertex_count += awk_nav_mesh.chunks[i].adjacency.length;
+		context->astar_queue.reserve(vertex_count);
+	}
+
+	if (mesh == JobMesh::Detour && context->detour_epoch != nav_epoch)
+	{
+		context->detour_epoch = nav_epoch;
+		if (nav_mesh)
+		{
+			dtStatus status = context->nav_mesh_query->init(nav_mesh, 2048);
+			vi_assert(dtStatusSucceed(status));
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+	if (context->state_epoch != state_epoch)
+	{
+		context->state_epoch = state_epoch;
+		context->sensors.resize(sensors.length);
+		memcpy(context->sensors.data, sensors.data, sizeof(SensorState) * sensors.length);
+		context->containment_fields.resize(containment_fields.length);
+		memcpy(context->containment_fields.data, containment_fields.data, sizeof(ContainmentFieldState) * containment_fields.length);
+		context->sensor_index.copy(sensor_index);
+		context->containment_field_index.copy(containment_field_index);
+	}
+}
+
+void job_execute(Context* context, const Job& job)
+{
+	switch (job.op)
+	{
+		case Op::Pathfind:
+		case Op::RandomPath:
+		{
+			Path path;
+
+			if (nav_mesh)
+			{
+				dtPolyRef start_poly = get_poly(context->nav_mesh_query, job.a, default_search_extents);
+				dtPolyRef end_poly = job.op == Op::RandomPath ? job.b_poly : get_poly(context->nav_mesh_query, job.b, default_search_extents);
+
+				if (start_poly && end_poly)
+					pathfind(context->nav_mesh_query, job.a, job.b, start_poly, end_poly, &path);
+			}
+
+			std::lock_guard<std::mutex> lock(out_mutex);
+			sync_out.write(Callback::Path);
+			sync_out.write(job.callback);
+			sync_out.write(path);
+			sync_out.write_commit();
+			break;
+		}
+		case Op::AwkPathfind:
+		{
+			AwkPath path;
+			Team team = job.team;
+
+			switch (job.type)
+			{
+				case AwkPathfind::LongRange:
+				{
+					awk_pathfind_internal(context, job.rule, team, awk_closest_point(context, team, job.a, job.a_normal), awk_closest_point(context, team, job.b, job.b_normal), &path);
+					break;
+				}
+				case AwkPathfind::Target:
+				{
+					awk_pathfind_hit(context, job.rule, team, job.a, job.a_normal, job.b, &path);
+					break;
+				}
+				case AwkPathfind::Random:
+				{
+					RandomScorer scorer;
+					scorer.start_vertex = awk_closest_point(context, team, job.a, job.a_normal);
+					scorer.start_pos = job.a;
+					scorer.minimum_distance = job.rule == AwkAllow::Crawl ? AWK_MAX_DISTANCE * 0.5f : AWK_MAX_DISTANCE * 3.0f;
+					scorer.minimum_distance = vi_min(scorer.minimum_distance,
+						vi_min(awk_nav_mesh.size.x, awk_nav_mesh.size.z) * awk_nav_mesh.chunk_size * 0.5f);
+					scorer.goal = job.b;
+
+					awk_astar(context, job.rule, team, scorer.start_vertex, &scorer, &path);
+					break;
+				}
+				case AwkPathfind::Away:
+				{
+					AwayScorer scorer;
+					scorer.start_vertex = awk_closest_point(context, team, job.a, job.a_normal);
+					scorer.away_vertex = awk_closest_point(context, team, job.b, job.b_normal);
+					if (!scorer.away_vertex.equals(AWK_NAV_MESH_NODE_NONE))
+					{
+						scorer.away_pos = job.b;
+						scorer.minimum_distance = job.rule == AwkAllow::Crawl ? AWK_MAX_DISTANCE * 0.5f : AWK_MAX_DISTANCE * 3.0f;
+						scorer.minimum_distance = vi_min(scorer.minimum_distance,
+							vi_min(awk_nav_mesh.size.x, awk_nav_mesh.size.z) * awk_nav_mesh.chunk_size * 0.5f);
+
+						awk_astar(context, job.rule, team, scorer.start_vertex, &scorer, &path);
+					}
+					break;
+				}
+				default:
+				{
+					vi_assert(false);
+					break;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(out_mutex);
+			sync_out.write(Callback::AwkPath);
+			sync_out.write(job.awk_callback);
+			sync_out.write(path);
+			sync_out.write_commit();
+			break;
+		}
+		default:
+		{
+			vi_assert(false);
+			break;
+		}
+	}
+}
+
+void worker_loop(Context* context)
+{
+	context->nav_mesh_query = dtAllocNavMeshQuery();
+
+	while (true)
+	{
+		Job job;
+		JobMesh mesh;
+		{
+			std::unique_lock<std::mutex> lock(job_mutex);
+			while (job_read == jobs.length && !jobs_quit)
+				job_condition.wait(lock);
+			if (job_read == jobs.length) // quitting
+				break;
+			job = jobs[job_read];
+			job_read++;
+			if (job_read == jobs.length)
+			{
+				jobs.length = 0;
+				job_read = 0;
+			}
+			mesh = job_mesh(job.op);
+			while (mesh_writing[(s32)mesh])
+				job_condition.wait(lock);
+			jobs_running[(s32)mesh]++;
+		}
+
+		context_refresh(context, mesh);
+		job_execute(context, job);
+
+		{
+			std::lock_guard<std::mutex> lock(job_mutex);
+			jobs_running[(s32)mesh]--;
+			if (jobs_running[(s32)mesh] == 0)
+				idle_condition.notify_all();
+		}
+	}
+
+	dtFreeNavMeshQuery(context->nav_mesh_query);
+}
+
+#if DEBUG_AI_BENCHMARK
+// random-goal searches from random starting vertices, same as AwkPathfind::Random
+void benchmark()
+{
+	s32 vertex_count = 0;
+	for (s32 i = 0; i < awk_nav_mesh.chunks.length; i++)
+		vertex_count += awk_nav_mesh.chunks[i].vertices.length;
+	if (vertex_count == 0)
+		return;
+
+	Context context;
+	context.nav_mesh_query = dtAllocNavMeshQuery();
+	context_refresh(&context, JobMesh::Awk);
+
+	s32 searches = 0;
+	s32 path_nodes = 0;
+	r64 elapsed = 0.0;
+	for (s32 i = 0; i < BENCHMARK_SEARCHES; i++)
+	{
+		AwkNavMeshNode start;
+		start.chunk = u16(mersenne::randf_co() * awk_nav_mesh.chunks.length);
+		const AwkNavMeshChunk& chunk = awk_nav_mesh.chunks[start.chunk];
+		if (chunk.vertices.length == 0)
+			continue;
+		start.vertex = u16(mersenne::randf_co() * chunk.vertices.length);
+
+		AwkAllow rule = (i % 2) ? AwkAllow::Crawl : AwkAllow::All;
+		RandomScorer scorer;
+		scorer.start_vertex = start;
+		scorer.start_pos = chunk.vertices[start.vertex];
+		scorer.minimum_distance = rule == AwkAllow::Crawl ? AWK_MAX_DISTANCE * 0.5f : AWK_MAX_DISTANCE * 3.0f;
+		scorer.minimum_distance = vi_min(scorer.minimum_distance,
+			vi_min(awk_nav_mesh.size.x, awk_nav_mesh.size.z) * awk_nav_mesh.chunk_size * 0.5f);
+		scorer.goal = awk_nav_mesh.vmin +
+		Vec3
+		(
+			mersenne::randf_co() * (awk_nav_mesh.size.x * awk_nav_mesh.chunk_size),
+			mersenne::randf_co() * (awk_nav_mesh.size.y * awk_nav_mesh.chunk_size),
+			mersenne::randf_co() * (awk_nav_mesh.size.z * awk_nav_mesh.chunk_size)
+		);
+
+		AwkPath path;
+		r64 start_time = platform::time();
+		awk_astar(&context, rule, TeamNone, start, &scorer, &path);
+		elapsed += platform::time() - start_time;
+		searches++;
+		path_nodes += path.length;
+	}
+
+	vi_debug("A* benchmark: %d vertices, %d searches, %fms per search, %f nodes per path", vertex_count, searches, r32((elapsed * 1000.0) / vi_max(searches, 1)), r32(path_nodes) / r32(vi_max(searches, 1)));
+
+	dtFreeNavMeshQuery(context.nav_mesh_query);
+}
+#endif
+
 void loop()
 {
 	nav_mesh_query = dtAllocNavMeshQuery();
@@ -575,12 +1069,24 @@ void loop()
 	default_query_filter.setExcludeFlags(0);
 
 	Array<u32> obstacle_recast_ids;
+	Array<ObstacleChange> obstacle_changes;
+
+	{
+		std::lock_guard<std::mutex> state_lock(state_mutex);
+		state_publish();
+	}
+
+	s32 worker_count = vi_max(1, vi_min(WORKERS_MAX, s32(std::thread::hardware_concurrency()) / 2));
+	std::thread workers[WORKERS_MAX];
+	for (s32 i = 0; i < worker_count; i++)
+		workers[i] = std::thread(&worker_loop, &contexts[i]);
 
 	b8 run = true;
 	Op op;
 	while (run)
 	{
-		sync_in.lock_wait_read();
+		sync_in.read_wait();
+		std::lock_guard<std::mutex> lock(mutex);
 		sync_in.read(&op);
 		switch (op)
 		{
@@ -590,6 +1096,9 @@ void loop()
 				vi_debug("Loading nav mesh...");
 				r32 start_time = platform::time();
 #endif
+				mesh_write_begin(JobMesh::Detour);
+				mesh_write_begin(JobMesh::Awk);
+
 				// free old data if necessary
 				{
 					if (nav_mesh)
@@ -604,10 +1113,6 @@ void loop()
 					}
 					awk_nav_mesh.~AwkNavMesh();
 					new (&awk_nav_mesh) AwkNavMesh();
-					awk_nav_mesh_key.~AwkNavMeshKey();
-					new (&awk_nav_mesh_key) AwkNavMeshKey();
-
-					sensors.length = 0;
 				}
 
 				s32 data_length;
@@ -734,16 +1239,23 @@ void loop()
 					}
 				}
 
-				awk_nav_mesh_key.resize(awk_nav_mesh);
+				nav_epoch++; // contexts pick up the new meshes on their next job
+
 				{
-					// reserve space in the A* queue
-					s32 vertex_count = 0;
-					for (s32 i = 0; i < awk_nav_mesh.chunks.length; i++)
-						vertex_count += awk_nav_mesh.chunks[i].adjacency.length;
-					astar_queue.reserve(vertex_count);
+					// the chunk indices depend on the awk nav mesh layout
+					std::lock_guard<std::mutex> state_lock(state_mutex);
+					sensors.length = 0;
+					state_publish();
 				}
 
-				sync_in.unlock();
+				sync_in.read_commit();
+
+				mesh_write_end(JobMesh::Detour);
+				mesh_write_end(JobMesh::Awk);
+
+#if DEBUG_AI_BENCHMARK
+				benchmark();
+#endif
 
 #if DEBUG_AI
 				vi_debug("Done in %fs.", (r32)(platform::time() - start_time));
@@ -751,178 +1263,107 @@ void loop()
 
 				break;
 			}
-			case Op::ObstacleAdd:
+			case Op::ObstacleUpdate:
 			{
-				u32 id;
-				sync_in.read(&id);
-				u32 recast_id;
-				Vec3 pos;
-				sync_in.read(&pos);
-				r32 radius;
-				sync_in.read(&radius);
-				r32 height;
-				sync_in.read(&height);
-				sync_in.unlock();
+				s32 count;
+				sync_in.read(&count);
+				obstacle_changes.resize(count);
+				sync_in.read(obstacle_changes.data, count);
+				sync_in.read_commit();
 
 				if (nav_tile_cache)
 				{
-					if ((s32)id > obstacle_recast_ids.length - 1)
-						obstacle_recast_ids.resize(id + 1);
-					dtStatus status = nav_tile_cache->addObstacle((r32*)&pos, radius, height, &recast_id);
-					obstacle_recast_ids[id] = recast_id;
-
-					nav_tile_cache->update(0.0f, nav_mesh); // todo: batch obstacle API calls together
-				}
-				break;
-			}
-			case Op::ObstacleRemove:
-			{
-				u32 id;
-				sync_in.read(&id);
-				sync_in.unlock();
+					mesh_write_begin(JobMesh::Detour);
+					for (s32 i = 0; i < obstacle_changes.length; i++)
+					{
+						const ObstacleChange& change = obstacle_changes[i];
+						dtStatus status;
+						while (true)
+						{
+							if (change.add)
+							{
+								if ((s32)change.id > obstacle_recast_ids.length - 1)
+									obstacle_recast_ids.resize(change.id + 1);
+								status = nav_tile_cache->addObstacle((r32*)&change.pos, change.radius, change.height, &obstacle_recast_ids[change.id]);
+							}
+							else
+								status = nav_tile_cache->removeObstacle(obstacle_recast_ids[change.id]);
 
-				if (nav_tile_cache)
-				{
-					u32 recast_id = obstacle_recast_ids[id];
-					nav_tile_cache->removeObstacle(recast_id);
+							if (dtStatusDetail(status, DT_BUFFER_TOO_SMALL))
+								nav_tile_cache->update(0.0f, nav_mesh); // request queue is full; process it and try again
+							else
+								break;
+						}
+					}
 
-					nav_tile_cache->update(0.0f, nav_mesh); // todo: batch obstacle API calls together
+					// the tile cache merges requests that touch the same tile,
+					// so this rebuilds at most as many tiles as one update per change would
+					for (s32 i = 0; i < obstacle_changes.length; i++)
+						nav_tile_cache->update(0.0f, nav_mesh);
+					mesh_write_end(JobMesh::Detour);
 				}
 				break;
 			}
 			case Op::Pathfind:
 			{
-				Vec3 a;
-				Vec3 b;
-				LinkEntryArg<Path> callback;
-				sync_in.read(&a);
-				sync_in.read(&b);
-				sync_in.read(&callback);
-				sync_in.unlock();
-
-				dtPolyRef start_poly = get_poly(a, default_search_extents);
-
-				dtPolyRef end_poly = get_poly(b, default_search_extents);
-
-				Path path;
-
-				if (start_poly && end_poly)
-					pathfind(a, b, start_poly, end_poly, &path);
-				
-				sync_out.lock();
-				sync_out.write(Callback::Path);
-				sync_out.write(callback);
-				sync_out.write(path);
-				sync_out.unlock();
-
+				Job job;
+				job.op = op;
+				sync_in.read(&job.a);
+				sync_in.read(&job.b);
+				sync_in.read(&job.callback);
+				sync_in.read_commit();
+				job_add(job);
 				break;
 			}
 			case Op::RandomPath:
 			{
-				Vec3 start;
-				sync_in.read(&start);
-				LinkEntryArg<Path> callback;
-				sync_in.read(&callback);
-				sync_in.unlock();
+				Job job;
+				job.op = op;
+				sync_in.read(&job.a);
+				sync_in.read(&job.callback);
+				sync_in.read_commit();
 
-				dtPolyRef start_poly = get_poly(start, default_search_extents);
-
-				Vec3 end;
-				dtPolyRef end_poly;
-				nav_mesh_query->findRandomPoint(&default_query_filter, mersenne::randf_co, &end_poly, (r32*)&end);
-
-				Path path;
-
-				if (start_poly && end_poly)
-					pathfind(start, end, start_poly, end_poly, &path);
-
-				sync_out.lock();
-				sync_out.write(Callback::Path);
-				sync_out.write(callback);
-				sync_out.write(path);
-				sync_out.unlock();
+				// the random number generator isn't thread safe, so pick the destination here
+				nav_mesh_query->findRandomPoint(&default_query_filter, mersenne::randf_co, &job.b_poly, (r32*)&job.b);
 
+				job_add(job);
 				break;
 			}
 			case Op::AwkPathfind:
 			{
-				AwkPathfind type;
-				AwkAllow rule;
-				Team team;
-				Vec3 start;
-				Vec3 start_normal;
-				sync_in.read(&type);
-				sync_in.read(&rule);
-				sync_in.read(&team);
-				LinkEntryArg<AwkPath> callback;
-				sync_in.read(&callback);
-				sync_in.read(&start);
-				sync_in.read(&start_normal);
-
-				AwkPath path;
-
-				switch (type)
+				Job job;
+				job.op = op;
+				sync_in.read(&job.type);
+				sync_in.read(&job.rule);
+				sync_in.read(&job.team);
+				sync_in.read(&job.awk_callback);
+				sync_in.read(&job.a);
+				sync_in.read(&job.a_normal);
+
+				switch (job.type)
 				{
 					case AwkPathfind::LongRange:
+					case AwkPathfind::Away:
 					{
-						Vec3 end;
-						sync_in.read(&end);
-						Vec3 end_normal;
-						sync_in.read(&end_normal);
-						sync_in.unlock();
-						awk_pathfind_internal(rule, team, awk_closest_point(team, start, start_normal), awk_closest_point(team, end, end_normal), &path);
+						sync_in.read(&job.b);
+						sync_in.read(&job.b_normal);
 						break;
 					}
 					case AwkPathfind::Target:
 					{
-						Vec3 end;
-						sync_in.read(&end);
-						sync_in.unlock();
-						awk_pathfind_hit(rule, team, start, start_normal, end, &path);
+						sync_in.read(&job.b);
 						break;
 					}
 					case AwkPathfind::Random:
 					{
-						sync_in.unlock();
-
-						RandomScorer scorer;
-						scorer.start_vertex = awk_closest_point(team, start, start_normal);
-						scorer.start_pos = start;
-						scorer.minimum_distance = rule == AwkAllow::Crawl ? AWK_MAX_DISTANCE * 0.5f : AWK_MAX_DISTANCE * 3.0f;
-						scorer.minimum_distance = vi_min(scorer.minimum_distance,
-							vi_min(awk_nav_mesh.size.x, awk_nav_mesh.size.z) * awk_nav_mesh.chunk_size * 0.5f);
-						scorer.goal = awk_nav_mesh.vmin +
+						// goal
+						job.b = awk_nav_mesh.vmin +
 						Vec3
 						(
 							mersenne::randf_co() * (awk_nav_mesh.size.x * awk_nav_mesh.chunk_size),
 							mersenne::randf_co() * (awk_nav_mesh.size.y * awk_nav_mesh.chunk_size),
 							mersenne::randf_co() * (awk_nav_mesh.size.z * awk_nav_mesh.chunk_size)
 						);
-
-						awk_astar(rule, team, scorer.start_vertex, &scorer, &path);
-
-						break;
-					}
-					case AwkPathfind::Away:
-					{
-						Vec3 away;
-						sync_in.read(&away);
-						Vec3 away_normal;
-						sync_in.read(&away_normal);
-						sync_in.unlock();
-
-						AwayScorer scorer;
-						scorer.start_vertex = awk_closest_point(team, start, start_normal);
-						scorer.away_vertex = awk_closest_point(team, away, away_normal);
-						if (!scorer.away_vertex.equals(AWK_NAV_MESH_NODE_NONE))
-						{
-							scorer.away_pos = away;
-							scorer.minimum_distance = rule == AwkAllow::Crawl ? AWK_MAX_DISTANCE * 0.5f : AWK_MAX_DISTANCE * 3.0f;
-							scorer.minimum_distance = vi_min(scorer.minimum_distance,
-								vi_min(awk_nav_mesh.size.x, awk_nav_mesh.size.z) * awk_nav_mesh.chunk_size * 0.5f);
-
-							awk_astar(rule, team, scorer.start_vertex, &scorer, &path);
-						}
 						break;
 					}
 					default:
@@ -931,12 +1372,9 @@ void loop()
 						break;
 					}
 				}
+				sync_in.read_commit();
 
-				sync_out.lock();
-				sync_out.write(Callback::AwkPath);
-				sync_out.write(callback);
-				sync_out.write(path);
-				sync_out.unlock();
+				job_add(job);
 				break;
 			}
 			case Op::AwkMarkAdjacencyBad:
@@ -945,7 +1383,9 @@ void loop()
 				sync_in.read(&a);
 				AwkNavMeshNode b;
 				sync_in.read(&b);
-				sync_in.unlock();
+				sync_in.read_commit();
+
+				mesh_write_begin(JobMesh::Awk);
 
 				// remove b from a's adjacency list
 				AwkNavMeshAdjacency* adjacency = &awk_nav_mesh.chunks[a.chunk].adjacency[a.vertex];
@@ -958,10 +1398,12 @@ void loop()
 					}
 				}
 
+				mesh_write_end(JobMesh::Awk);
 				break;
 			}
 			case Op::UpdateState:
 			{
+				std::lock_guard<std::mutex> state_lock(state_mutex);
 				s32 count;
 				sync_in.read(&count);
 				sensors.resize(count);
@@ -969,12 +1411,13 @@ void loop()
 				sync_in.read(&count);
 				containment_fields.resize(count);
 				sync_in.read(containment_fields.data, containment_fields.length);
-				sync_in.unlock();
+				sync_in.read_commit();
+				state_publish();
 				break;
 			}
 			case Op::Quit:
 			{
-				sync_in.unlock();
+				sync_in.read_commit();
 				run = false;
 				break;
 			}
@@ -985,37 +1428,79 @@ void loop()
 			}
 		}
 	}
+
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		jobs_quit = true;
+	}
+	job_condition.notify_all();
+	for (s32 i = 0; i < worker_count; i++)
+		workers[i].join();
 }
 
 // Awk nav mesh stuff
 
+AwkNavMeshKey::AwkNavMeshKey()
+	: chunk_offsets(),
+	travel_score(),
+	estimate_score(),
+	sensor_score(),
+	parent(),
+	generation(),
+	flags(),
+	current_generation()
+{
+}
+
 void AwkNavMeshKey::resize(const AwkNavMesh& nav)
 {
-	data.chunk_size = nav.chunk_size;
-	data.size.x = nav.size.x;
-	data.size.y = nav.size.y;
-	data.size.z = nav.size.z;
-	data.vmin = nav.vmin;
-	data.resize();
-	for (s32 i = 0; i < data.chunks.length; i++)
-		data.chunks[i].resize(nav.chunks[i].vertices.length);
+	chunk_offsets.resize(nav.chunks.length);
+	s32 vertex_count = 0;
+	for (s32 i = 0; i < nav.chunks.length; i++)
+	{
+		chunk_offsets[i] = vertex_count;
+		vertex_count += nav.chunks[i].vertices.length;
+	}
+
+	travel_score.resize(vertex_count);
+	estimate_score.resize(vertex_count);
+	sensor_score.resize(vertex_count);
+	parent.resize(vertex_count);
+	generation.resize(vertex_count);
+	flags.resize(vertex_count);
+
+	memset(generation.data, 0, sizeof(u16) * generation.length);
+	current_generation = 0;
 }
 
+// O(1) unless the generation counter wraps around
 void AwkNavMeshKey::reset()
 {
-	for (s32 i = 0; i < data.chunks.length; i++)
-		memset(data.chunks[i].data, 0, sizeof(AwkNavMeshNodeData) * data.chunks[i].length);
+	current_generation++;
+	if (current_generation == 0)
+	{
+		// stale stamps from 65535 searches ago could look current
+		memset(generation.data, 0, sizeof(u16) * generation.length);
+		current_generation = 1;
+	}
 }
 
-r32 AwkNavMeshKey::priority(const AwkNavMeshNode& a)
+// returns the flat index of the node, clearing its flags first if the current search hasn't touched it yet
+s32 AwkNavMeshKey::touch(const AwkNavMeshNode& node)
 {
-	const AwkNavMeshNodeData& data = get(a);
-	return data.travel_score + data.estimate_score + data.sensor_score;
+	s32 i = index(node);
+	if (generation[i] != current_generation)
+	{
+		generation[i] = current_generation;
+		flags[i] = 0;
+	}
+	return i;
 }
 
-AwkNavMeshNodeData& AwkNavMeshKey::get(const AwkNavMeshNode& node)
+r32 AwkNavMeshKey::priority(const AwkNavMeshNode& a) const
 {
-	return data.chunks[node.chunk][node.vertex];
+	s32 i = index(a);
+	return travel_score[i] + estimate_score[i] + sensor_score[i];
 }
 
 
@@ -8,7 +8,7 @@ namespace Asset
 {
 	namespace Uniform
 	{
-		const s32 count = 50;
+		const s32 count = 51;
 		const AssetID ambient_color = 0;
 		const AssetID bones = 1;
 		const AssetID buffer_size = 2;
@@ -32,33 +32,34 @@ namespace Asset
 		const AssetID inv_uv_scale = 20;
 		const AssetID lifetime = 21;
 		const AssetID light_color = 22;
-		const AssetID light_direction = 23;
-		const AssetID light_fov_dot = 24;
-		const AssetID light_pos = 25;
-		const AssetID light_radius = 26;
-		const AssetID light_vp = 27;
-		const AssetID lighting_buffer = 28;
-		const AssetID mv = 29;
-		const AssetID mvp = 30;
-		const AssetID noise_sampler = 31;
-		const AssetID normal_buffer = 32;
-		const AssetID normal_map = 33;
-		const AssetID p = 34;
-		const AssetID player_light = 35;
-		const AssetID range = 36;
-		const AssetID range_center = 37;
-		const AssetID scan_line_interval = 38;
-		const AssetID shadow_map = 39;
-		const AssetID size = 40;
-		const AssetID ssao_buffer = 41;
-		const AssetID time = 42;
-		const AssetID type = 43;
-		const AssetID uv_offset = 44;
-		const AssetID uv_scale = 45;
-		const AssetID v = 46;
-		const AssetID viewport_scale = 47;
-		const AssetID vp = 48;
-		const AssetID wall_normal = 49;
+		const AssetID light_count = 23;
+		const AssetID light_direction = 24;
+		const AssetID light_fov_dot = 25;
+		const AssetID light_pos = 26;
+		const AssetID light_radius = 27;
+		const AssetID light_vp = 28;
+		const AssetID lighting_buffer = 29;
+		const AssetID mv = 30;
+		const AssetID mvp = 31;
+		const AssetID noise_sampler = 32;
+		const AssetID normal_buffer = 33;
+		const AssetID normal_map = 34;
+		const AssetID p = 35;
+		const AssetID player_light = 36;
+		const AssetID range = 37;
+		const AssetID range_center = 38;
+		const AssetID scan_line_interval = 39;
+		const AssetID shadow_map = 40;
+		const AssetID size = 41;
+		const AssetID ssao_buffer = 42;
+		const AssetID time = 43;
+		const AssetID type = 44;
+		const AssetID uv_offset = 45;
+		const AssetID uv_scale = 46;
+		const AssetID v = 47;
+		const AssetID viewport_scale = 48;
+		const AssetID vp = 49;
+		const AssetID wall_normal = 50;
 	}
 	namespace Shader
 	{
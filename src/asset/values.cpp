@@ -533,6 +533,7 @@ const char* AssetLookup::Uniform::names[] =
 	"inv_uv_scale",
 	"lifetime",
 	"light_color",
+	"light_count",
 	"light_direction",
 	"light_fov_dot",
 	"light_pos",
@@ -19,6 +19,7 @@ b8 Console::fps_visible = false;
 s32 Console::fps_count = 0;
 r32 Console::fps_accumulator = 0;
 r32 Console::longest_frame_time = 0;
+RenderStats Console::render_stats;
 b8 Console::visible = false;
 char Console::shift_map[127];
 char Console::normal_map[127];
@@ -127,7 +128,18 @@ void Console::update(const Update& u)
 		if (fps_accumulator > 0.5f)
 		{
 			char fps_label[256];
-			sprintf(fps_label, "%.0f %.0fms", fps_count / fps_accumulator, longest_frame_time * 1000.0f);
+			sprintf
+			(
+				fps_label,
+				"%.0f %.0fms\n%d draws %d/%d shaders %d/%d uniforms %d/%d textures %d/%d vaos",
+				fps_count / fps_accumulator,
+				longest_frame_time * 1000.0f,
+				render_stats.draws,
+				render_stats.shaders, render_stats.shaders + render_stats.shaders_skipped,
+				render_stats.uniforms, render_stats.uniforms + render_stats.uniforms_skipped,
+				render_stats.textures, render_stats.textures + render_stats.textures_skipped,
+				render_stats.vertex_arrays, render_stats.vertex_arrays + render_stats.vertex_arrays_skipped
+			);
 			fps_text.text(fps_label);
 			fps_accumulator = 0.0f;
 			fps_count = 0;
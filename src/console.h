@@ -27,6 +27,7 @@ struct Console
 	static r32 fps_accumulator;
 	static r32 longest_frame_time;
 	static b8 fps_visible;
+	static RenderStats render_stats;
 	static char shift_map[127];
 	static char normal_map[127];
 	static r32 repeat_start_time;
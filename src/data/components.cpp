@@ -5,6 +5,59 @@
 namespace VI
 {
 
+Vec3 Transform::cache_pos[MAX_ENTITIES];
+Quat Transform::cache_rot[MAX_ENTITIES];
+b8 Transform::cache_active;
+
+// parents are always computed before their children, so every transform is visited once
+void Transform::cache_build()
+{
+	static Bitmask<MAX_ENTITIES> done;
+	done.clear();
+	ID chain[MAX_ENTITIES];
+	for (auto i = list.iterator(); !i.is_last(); i.next())
+	{
+		if (done.get(i.index))
+			continue;
+
+		// collect the ancestors we haven't computed yet
+		s32 chain_length = 0;
+		Transform* t = i.item();
+		while (t && !done.get(t->id()))
+		{
+			chain[chain_length] = t->id();
+			chain_length++;
+			t = t->parent.ref();
+		}
+
+		// then work back down from the highest one
+		for (s32 j = chain_length - 1; j >= 0; j--)
+		{
+			ID id = chain[j];
+			const Transform& transform = list[id];
+			Transform* parent = transform.parent.ref();
+			if (parent)
+			{
+				ID parent_id = parent->id();
+				cache_rot[id] = cache_rot[parent_id] * transform.rot;
+				cache_pos[id] = (cache_rot[parent_id] * transform.pos) + cache_pos[parent_id];
+			}
+			else
+			{
+				cache_rot[id] = transform.rot;
+				cache_pos[id] = transform.pos;
+			}
+			done.set(id, true);
+		}
+	}
+	cache_active = true;
+}
+
+void Transform::cache_clear()
+{
+	cache_active = false;
+}
+
 Transform::Transform()
 	: parent(), pos(Vec3::zero), rot(Quat::identity)
 {
@@ -13,15 +66,11 @@ Transform::Transform()
 
 void Transform::mat(Mat4* m) const
 {
-	*m = Mat4::identity;
-	Transform* t = const_cast<Transform*>(this);
-	while (t)
-	{ 
-		Mat4 local = Mat4(t->rot);
-		local.translation(t->pos);
-		*m = *m * local;
-		t = t->parent.ref();
-	}
+	Vec3 abs_pos;
+	Quat abs_rot;
+	absolute(&abs_pos, &abs_rot);
+	*m = Mat4(abs_rot);
+	m->translation(abs_pos);
 }
 
 void Transform::get_bullet(btTransform& world) const
@@ -35,17 +84,19 @@ void Transform::get_bullet(btTransform& world) const
 
 void Transform::set_bullet(const btTransform& world)
 {
+	vi_assert(!cache_active);
 	pos = world.getOrigin();
 	rot = world.getRotation();
 }
 
 void Transform::set(const Vec3& p, const Quat& r)
 {
+	vi_assert(!cache_active);
 	pos = p;
 	rot = r;
 }
 
-void Transform::absolute(Vec3* abs_pos, Quat* abs_rot) const
+void Transform::absolute_uncached(Vec3* abs_pos, Quat* abs_rot) const
 {
 	*abs_rot = Quat::identity;
 	*abs_pos = Vec3::zero;
@@ -58,8 +109,21 @@ void Transform::absolute(Vec3* abs_pos, Quat* abs_rot) const
 	}
 }
 
+void Transform::absolute(Vec3* abs_pos, Quat* abs_rot) const
+{
+	if (cache_active)
+	{
+		ID i = id();
+		*abs_pos = cache_pos[i];
+		*abs_rot = cache_rot[i];
+	}
+	else
+		absolute_uncached(abs_pos, abs_rot);
+}
+
 void Transform::absolute(const Vec3& abs_pos, const Quat& abs_rot)
 {
+	vi_assert(!cache_active);
 	if (parent.ref())
 	{
 		Quat parent_rot;
@@ -78,6 +142,9 @@ void Transform::absolute(const Vec3& abs_pos, const Quat& abs_rot)
 
 Quat Transform::absolute_rot() const
 {
+	if (cache_active)
+		return cache_rot[id()];
+
 	Quat q = Quat::identity;
 	Transform* t = const_cast<Transform*>(this);
 	while (t)
@@ -90,6 +157,7 @@ Quat Transform::absolute_rot() const
 
 void Transform::absolute_rot(const Quat& q)
 {
+	vi_assert(!cache_active);
 	if (parent.ref())
 		rot = parent.ref()->absolute_rot().inverse() * q;
 	else
@@ -98,6 +166,9 @@ void Transform::absolute_rot(const Quat& q)
 
 Vec3 Transform::absolute_pos() const
 {
+	if (cache_active)
+		return cache_pos[id()];
+
 	Vec3 abs_pos = Vec3::zero;
 	Transform* t = const_cast<Transform*>(this);
 	while (t)
@@ -110,6 +181,7 @@ Vec3 Transform::absolute_pos() const
 
 void Transform::absolute_pos(const Vec3& p)
 {
+	vi_assert(!cache_active);
 	if (parent.ref())
 		pos = parent.ref()->to_local(p);
 	else
@@ -118,12 +190,16 @@ void Transform::absolute_pos(const Vec3& p)
 
 Vec3 Transform::to_world(const Vec3& p) const
 {
-	Quat abs_rot = Quat::identity;
+	if (cache_active)
+	{
+		ID i = id();
+		return (cache_rot[i] * p) + cache_pos[i];
+	}
+
 	Vec3 abs_pos = p;
 	Transform* t = const_cast<Transform*>(this);
 	while (t)
 	{ 
-		abs_rot = t->rot * abs_rot;
 		abs_pos = (t->rot * abs_pos) + t->pos;
 		t = t->parent.ref();
 	}
@@ -151,6 +227,14 @@ Vec3 Transform::to_local_normal(const Vec3& p) const
 
 void Transform::to_world(Vec3* p, Quat* q) const
 {
+	if (cache_active)
+	{
+		ID i = id();
+		*q = cache_rot[i] * *q;
+		*p = (cache_rot[i] * *p) + cache_pos[i];
+		return;
+	}
+
 	Transform* t = const_cast<Transform*>(this);
 	while (t)
 	{ 
@@ -175,6 +259,7 @@ void Transform::to_local(Vec3* p, Quat* q) const
 void Transform::reparent(Transform* p)
 {
 	vi_assert(p != this);
+	vi_assert(!cache_active);
 	Quat abs_rot;
 	Vec3 abs_pos;
 	absolute(&abs_pos, &abs_rot);
@@ -9,6 +9,15 @@ namespace VI
 
 struct Transform : public ComponentType<Transform>
 {
+	// world space transforms, computed in one pass and indexed by ID.
+	// while the cache is active, all the world space queries below read from it instead of walking the parent chain.
+	// nothing may move while it's active, so only use it for read-only passes like rendering.
+	static Vec3 cache_pos[MAX_ENTITIES];
+	static Quat cache_rot[MAX_ENTITIES];
+	static b8 cache_active;
+	static void cache_build();
+	static void cache_clear();
+
 	Ref<Transform> parent;
 	Vec3 pos;
 	Quat rot;
@@ -33,6 +42,7 @@ struct Transform : public ComponentType<Transform>
 
 	void absolute(Vec3*, Quat*) const;
 	void absolute(const Vec3&, const Quat&);
+	void absolute_uncached(Vec3*, Quat*) const;
 	Vec3 absolute_pos() const;
 	void absolute_pos(const Vec3&);
 	Quat absolute_rot() const;
@@ -74,7 +84,7 @@ struct SpotLight : public ComponentType<SpotLight>
 	void awake() {}
 };
 
-struct DirectionalLight : public ComponentType<DirectionalLight>
+struct DirectionalLight : public ComponentType<DirectionalLight, 16>
 {
 	Vec3 color;
 	b8 shadowed;
@@ -1,12 +1,14 @@
 #include "entity.h"
 #include <new>
 #include "net.h"
+#include "ai.h"
 
 namespace VI
 {
 
 PinArray<Entity, MAX_ENTITIES> Entity::list;
 Array<ID> World::remove_buffer;
+Array<Ref<Entity> > World::create_buffer;
 ComponentPoolBase* World::component_pools[MAX_FAMILIES];
 #if SERVER && DEBUG
 Array<Ref<Entity> > World::create_queue;
@@ -97,9 +99,31 @@ void World::remove_deferred(Entity* e)
 
 void World::flush()
 {
+	// awake one component type at a time across all new entities
+	for (Family f = 0; f < World::families; f++)
+	{
+		ComponentMask mask = (ComponentMask)1 << f;
+		for (s32 i = 0; i < create_buffer.length; i++)
+		{
+			Entity* e = create_buffer[i].ref();
+			if (e && (e->component_mask & mask))
+				component_pools[f]->awake(e->components[f]);
+		}
+	}
+	for (s32 i = 0; i < create_buffer.length; i++)
+	{
+		Entity* e = create_buffer[i].ref();
+		if (e)
+			Net::finalize(e);
+	}
+	create_buffer.length = 0;
+
 	for (s32 i = 0; i < remove_buffer.length; i++)
 		internal_remove(&Entity::list[remove_buffer[i]]);
 	remove_buffer.length = 0;
+
+	// walkers toggle obstacles as they start and stop, and removed entities take theirs with them
+	AI::obstacles_flush();
 }
 
 LinkEntry::LinkEntry()
@@ -19,6 +19,7 @@ struct ComponentPoolBase
 	virtual void net_add(ID, ID, Revision) = 0;
 	virtual void remove(ID) = 0;
 	virtual Revision revision(ID) = 0;
+	virtual s32 capacity() = 0;
 };
 
 template<typename T> struct Ref
@@ -52,6 +53,7 @@ template<typename T> struct Ref
 	{
 		if (id == IDNull)
 			return nullptr;
+		vi_assert(s32(id) < s32(T::list.capacity()));
 		T* target = &T::list[id];
 		return target->revision == revision ? target : nullptr;
 	}
@@ -97,6 +99,11 @@ struct ComponentPool : public ComponentPoolBase
 	{
 		return T::list[id].revision;
 	}
+
+	virtual s32 capacity()
+	{
+		return T::list.capacity();
+	}
 };
 
 struct Entity
@@ -128,6 +135,7 @@ struct World
 {
 	static Family families;
 	static Array<ID> remove_buffer;
+	static Array<Ref<Entity> > create_buffer;
 	static ComponentPoolBase* component_pools[MAX_FAMILIES];
 #if SERVER && DEBUG
 	static Array<Ref<Entity> > create_queue;
@@ -153,6 +161,16 @@ struct World
 		return (T*)e;
 	}
 
+	// constructs the entity now, but awakes and finalizes it in World::flush along with everything else created this frame.
+	// until then its components may be updated without having been awoken.
+	template<typename T, typename... Args> static T* create_deferred(Args... args)
+	{
+		Entity* e = Entity::list.add();
+		new (e) T(args...);
+		create_buffer.add(e);
+		return (T*)e;
+	}
+
 	static void remove(Entity*);
 	static void remove_deferred(Entity*);
 	static void awake(Entity*);
@@ -375,12 +393,15 @@ struct LinkArg
 	}
 };
 
-template<typename Derived>
+// size is how many of this component can exist at once.
+// most components can go on any entity, but rare ones can reserve fewer slots.
+template<typename Derived, s32 size = MAX_ENTITIES>
 struct ComponentType : public ComponentBase
 {
+	static const s32 capacity = size;
 	static Family family;
 	static ComponentMask component_mask;
-	static PinArray<Derived, MAX_ENTITIES> list;
+	static PinArray<Derived, size> list;
 	static ComponentPool<Derived> pool;
 
 	inline ID id() const
@@ -400,10 +421,10 @@ struct ComponentType : public ComponentBase
 };
 
 #ifndef _MSC_VER
-template<typename T> Family ComponentType<T>::family;
-template<typename T> ComponentMask ComponentType<T>::component_mask;
-template<typename T> PinArray<T, MAX_ENTITIES> ComponentType<T>::list;
-template<typename T> ComponentPool<T> ComponentType<T>::pool;
+template<typename T, s32 size> Family ComponentType<T, size>::family;
+template<typename T, s32 size> ComponentMask ComponentType<T, size>::component_mask;
+template<typename T, s32 size> PinArray<T, size> ComponentType<T, size>::list;
+template<typename T, s32 size> ComponentPool<T> ComponentType<T, size>::pool;
 #endif
 
 }
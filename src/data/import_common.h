@@ -80,6 +80,7 @@ struct Mesh
 	Vec3 bounds_max;
 	r32 bounds_radius;
 	Vec4 color;
+	s32 attrib_count;
 	b8 instanced;
 	void reset()
 	{
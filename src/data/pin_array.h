@@ -1,10 +1,51 @@
 #pragma once
 
 #include "array.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace VI
 {
 
+// index of the lowest and highest set bit. x must be nonzero.
+inline s32 bit_lowest(u32 x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctz(x);
+#elif defined(_MSC_VER)
+	unsigned long result;
+	_BitScanForward(&result, x);
+	return s32(result);
+#else
+	s32 result = 0;
+	while (!(x & 1))
+	{
+		x >>= 1;
+		result++;
+	}
+	return result;
+#endif
+}
+
+inline s32 bit_highest(u32 x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 31 - __builtin_clz(x);
+#elif defined(_MSC_VER)
+	unsigned long result;
+	_BitScanReverse(&result, x);
+	return s32(result);
+#else
+	s32 result = 0;
+	while (x >>= 1)
+		result++;
+	return result;
+#endif
+}
+
+// start is the first set bit, end is one past the last set bit.
+// scans skip over empty words, so iterating a sparse mask costs one step per set bit plus one per 32 slots.
 template<u16 size> struct Bitmask
 {
 	u32 data[(size / (sizeof(u32) * 8)) + 1];
@@ -19,20 +60,43 @@ template<u16 size> struct Bitmask
 	inline b8 get(s32 i) const
 	{
 		vi_assert(i >= 0 && i < size);
-		s32 index = i / (sizeof(u32) * 8);
-		return data[index] & (1 << (i - (index * sizeof(u32) * 8)));
+		return data[i >> 5] & (1u << (i & 31));
 	}
 
+	// first set bit after i, or end if there is none
 	inline s32 next(s32 i) const
 	{
 		i++;
-		while (i < end)
+		if (i >= end)
+			return end;
+		s32 index = i >> 5;
+		u32 word = data[index] & (~0u << (i & 31));
+		while (!word)
 		{
-			if (get(i))
-				break;
-			i++;
+			index++;
+			if ((index << 5) >= end)
+				return end;
+			word = data[index];
 		}
-		return i;
+		return (index << 5) + bit_lowest(word);
+	}
+
+	// last set bit before i, or -1 if there is none
+	inline s32 previous(s32 i) const
+	{
+		i--;
+		if (i < start)
+			return -1;
+		s32 index = i >> 5;
+		u32 word = data[index] & (~0u >> (31 - (i & 31)));
+		while (!word)
+		{
+			index--;
+			if (index < 0 || ((index + 1) << 5) <= start)
+				return -1;
+			word = data[index];
+		}
+		return (index << 5) + bit_highest(word);
 	}
 
 	void clear()
@@ -45,38 +109,21 @@ template<u16 size> struct Bitmask
 	void set(s32 i, b8 value)
 	{
 		vi_assert(i >= 0 && i < size);
-		s32 index = i / (sizeof(u32) * 8);
-		u32 mask = 1 << (i - (index * sizeof(u32) * 8));
+		u32 mask = 1u << (i & 31);
 		if (value)
 		{
-			data[index] |= mask;
+			data[i >> 5] |= mask;
 			start = start < i ? start : i;
 			end = end > i + 1 ? end : (u16)(i + 1);
 		}
 		else
 		{
-			data[index] &= ~mask;
+			data[i >> 5] &= ~mask;
 
-			if (i == end)
-			{
-				s32 j;
-				for (j = i - 1; j > start; j--)
-				{
-					if (get(j))
-						break;
-				}
-				end = (u16)(j > 0 ? j : 0);
-			}
+			if (i + 1 == end)
+				end = (u16)(previous(i) + 1);
 			if (i == start)
-			{
-				s32 j;
-				for (j = i + 1; j < end; j++)
-				{
-					if (get(j))
-						break;
-				}
-				start = (u16)j;
-			}
+				start = (u16)next(i);
 			if (start >= end)
 			{
 				start = size;
@@ -139,6 +186,11 @@ struct PinArray
 		return size - free_list.length;
 	}
 
+	inline s32 capacity() const
+	{
+		return size;
+	}
+
 	inline T operator [] (const s32 i) const
 	{
 		vi_assert(i >= 0 && i < size);
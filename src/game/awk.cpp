@@ -279,9 +279,8 @@ void Awk::hit_target(Entity* target, const Vec3& hit_pos)
 				Vec4(1, 1, 1, 1)
 			);
 		}
-		Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+		Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 		shockwave->get<Transform>()->absolute_pos(hit_pos);
-		Net::finalize(shockwave);
 	}
 
 	// award credits for hitting stuff
@@ -713,9 +712,8 @@ b8 Awk::go(const Vec3& dir)
 		particle_trail(me, dir_normalized, (pos - me).length());
 
 		{
-			Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+			Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 			shockwave->get<Transform>()->absolute_pos(pos + rot * Vec3(0, 0, AWK_RADIUS));
-			Net::finalize(shockwave);
 		}
 
 		switch (current_ability)
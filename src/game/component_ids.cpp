@@ -56,10 +56,10 @@ COMPONENT_TYPE(34, SkyDecal) \
 Family World::families = 35;
 
 #define COMPONENT_TYPE(INDEX, TYPE) \
-template<> Family ComponentType<TYPE>::family = (INDEX); \
-template<> ComponentMask ComponentType<TYPE>::component_mask = (ComponentMask)1 << (INDEX); \
-template<> PinArray<TYPE, MAX_ENTITIES> ComponentType<TYPE>::list; \
-template<> ComponentPool<TYPE> ComponentType<TYPE>::pool;
+template<> Family ComponentType<TYPE, TYPE::capacity>::family = (INDEX); \
+template<> ComponentMask ComponentType<TYPE, TYPE::capacity>::component_mask = (ComponentMask)1 << (INDEX); \
+template<> PinArray<TYPE, TYPE::capacity> ComponentType<TYPE, TYPE::capacity>::list; \
+template<> ComponentPool<TYPE> ComponentType<TYPE, TYPE::capacity>::pool;
 
 	COMPONENTS()
 
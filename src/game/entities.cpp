@@ -40,9 +40,8 @@ void explosion(const Vec3& pos, const Quat& rot)
 			Vec4(1, 1, 1, 1)
 		);
 	}
-	Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+	Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 	shockwave->get<Transform>()->absolute_pos(pos);
-	Net::finalize(shockwave);
 }
 
 AwkEntity::AwkEntity(AI::Team team)
@@ -582,9 +581,8 @@ void Sensor::update_all(const Update& u)
 		r32 offset = i.index * sensor_shockwave_interval * 0.3f;
 		if ((s32)((time + offset) / sensor_shockwave_interval) != (s32)((last_time + offset) / sensor_shockwave_interval))
 		{
-			Entity* shockwave = World::create<ShockwaveEntity>(10.0f, 1.5f);
+			Entity* shockwave = World::create_deferred<ShockwaveEntity>(10.0f, 1.5f);
 			shockwave->get<Transform>()->absolute_pos(i.item()->get<Transform>()->absolute_pos());
-			Net::finalize(shockwave);
 		}
 	}
 }
@@ -1179,9 +1177,8 @@ void Teleporter::destroy()
 void teleport(Entity* e, Teleporter* target)
 {
 	{
-		Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+		Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 		shockwave->get<Transform>()->absolute_pos(e->get<Transform>()->absolute_pos());
-		Net::finalize(shockwave);
 	}
 
 	Vec3 pos;
@@ -1195,9 +1192,8 @@ void teleport(Entity* e, Teleporter* target)
 		teleport_pos.y = vi_max(teleport_pos.y, pos.y + 1.0f);
 		e->get<Walker>()->absolute_pos(teleport_pos);
 		{
-			Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+			Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 			shockwave->get<Transform>()->absolute_pos(pos);
-			Net::finalize(shockwave);
 		}
 	}
 	else if (e->has<Awk>())
@@ -1284,9 +1280,8 @@ void Projectile::update(const Update& u)
 				);
 			}
 			{
-				Entity* shockwave = World::create<ShockwaveEntity>(8.0f, 1.5f);
+				Entity* shockwave = World::create_deferred<ShockwaveEntity>(8.0f, 1.5f);
 				shockwave->get<Transform>()->absolute_pos(ray_callback.m_hitPointWorld);
-				Net::finalize(shockwave);
 			}
 			World::remove(entity());
 		}
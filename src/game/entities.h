@@ -94,7 +94,7 @@ struct ControlPointEntity : public Entity
 	ControlPointEntity(AI::Team, const Vec3&);
 };
 
-struct PlayerSpawn : public ComponentType<PlayerSpawn>
+struct PlayerSpawn : public ComponentType<PlayerSpawn, 32>
 {
 	AI::Team team;
 	void awake() {}
@@ -102,7 +102,7 @@ struct PlayerSpawn : public ComponentType<PlayerSpawn>
 
 #define CONTROL_POINT_RADIUS 3.0f
 #define CONTROL_POINT_CAPTURE_TIME 45.0f
-struct ControlPoint : public ComponentType<ControlPoint>
+struct ControlPoint : public ComponentType<ControlPoint, 64>
 {
 	static ControlPoint* closest(AI::TeamMask, const Vec3&, r32* = nullptr);
 	static s32 count(AI::TeamMask);
@@ -847,6 +847,7 @@ void Game::unload_level()
 		World::remove(i.item());
 
 	World::remove_buffer.length = 0; // any deferred requests to remove entities should be ignored; they're all gone
+	World::create_buffer.length = 0;
 
 	// clear local player list to make sure IDs match up
 	LocalPlayer::list.clear();
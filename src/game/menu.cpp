@@ -121,7 +121,7 @@ void title_menu(const Update& u, u8 gamepad, UIMenu* menu, State* state)
 				Game::session.multiplayer = true;
 				Game::session.local = false;
 				Game::unload_level();
-				Net::Client::connect("127.0.0.1", 3494);
+				Net::Client::connect("127.0.0.1", NET_SERVER_PORT);
 			}
 			if (menu->item(u, _(strings::options)))
 			{
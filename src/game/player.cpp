@@ -1514,7 +1514,11 @@ void LocalPlayerControl::update(const Update& u)
 		// crawling
 		{
 			Vec3 movement = get_movement(u, Quat::euler(0, get<PlayerCommon>()->angle_horizontal, get<PlayerCommon>()->angle_vertical));
-			get<Awk>()->crawl(movement, u);
+			Update crawl_update = u;
+#if !SERVER
+			Net::Client::awk_command(entity(), &movement, &crawl_update.time.delta); // predict locally and send to the server
+#endif
+			get<Awk>()->crawl(movement, crawl_update);
 		}
 
 		last_pos = get<Awk>()->center_lerped();
@@ -102,6 +102,8 @@ namespace LMath
 		return u + s * edge0 + t * edge1;
 	}
 
+	// segment test; spheres behind ray_start or past ray_end don't count.
+	// if ray_start is inside the sphere, the intersection is ray_start.
 	b8 ray_sphere_intersect(const Vec3& ray_start, const Vec3& ray_end, const Vec3& sphere_pos, r32 sphere_radius, Vec3* intersection)
 	{
 		Vec3 ray = ray_end - ray_start;
@@ -111,15 +113,26 @@ namespace LMath
 		r32 b = 2.0f * ray.dot(sphere_to_ray_start);
 		r32 c = sphere_to_ray_start.length_squared() - (sphere_radius * sphere_radius);
 
+		if (a == 0.0f)
+		{
+			if (c > 0.0f)
+				return false;
+			if (intersection)
+				*intersection = ray_start;
+			return true;
+		}
+
 		r32 delta = (b * b) - 4.0f * a * c;
 
 		if (delta > 0.0f)
 		{
-			r32 distance = (-b - sqrtf(delta)) / (2.0f * a);
-			if (distance < 1.0f)
+			r32 delta_sqrt = sqrtf(delta);
+			r32 distance_near = (-b - delta_sqrt) / (2.0f * a);
+			r32 distance_far = (-b + delta_sqrt) / (2.0f * a);
+			if (distance_near <= 1.0f && distance_far >= 0.0f)
 			{
 				if (intersection)
-					*intersection = ray_start + ray * distance;
+					*intersection = ray_start + ray * vi_max(distance_near, 0.0f);
 				return true;
 			}
 		}
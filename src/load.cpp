@@ -29,6 +29,7 @@ namespace Settings
 	b8 fullscreen;
 	b8 vsync;
 	b8 supersampling;
+	b8 tiled_lighting;
 }
 
 Array<Loader::Entry<Mesh> > Loader::meshes;
@@ -68,30 +69,30 @@ Array<const char*> mod_nav_paths;
 Array<const char*> mod_level_mesh_names;
 Array<const char*> mod_level_mesh_paths;
 
-void Loader::init(LoopSwapper* s)
-{
-	swapper = s;
+b8 asset_counts_initialized;
 
-	// count levels, static meshes, and static textures at runtime to avoid recompiling all the time
+// count levels, static meshes, and static textures at runtime to avoid recompiling all the time
+void asset_counts_init()
+{
 	const char* p;
-	while ((p = AssetLookup::Level::names[compiled_level_count]))
-		compiled_level_count++;
+	while ((p = AssetLookup::Level::names[Loader::compiled_level_count]))
+		Loader::compiled_level_count++;
 
-	while ((p = AssetLookup::Texture::names[static_texture_count]))
-		static_texture_count++;
+	while ((p = AssetLookup::Texture::names[Loader::static_texture_count]))
+		Loader::static_texture_count++;
 
-	while ((p = AssetLookup::Shader::names[shader_count]))
-		shader_count++;
+	while ((p = AssetLookup::Shader::names[Loader::shader_count]))
+		Loader::shader_count++;
 
-	while ((p = AssetLookup::Armature::names[armature_count]))
-		armature_count++;
+	while ((p = AssetLookup::Armature::names[Loader::armature_count]))
+		Loader::armature_count++;
 
-	while ((p = AssetLookup::Animation::names[animation_count]))
-		animation_count++;
+	while ((p = AssetLookup::Animation::names[Loader::animation_count]))
+		Loader::animation_count++;
 
-	while ((p = AssetLookup::Mesh::names[compiled_static_mesh_count]))
-		compiled_static_mesh_count++;
-	static_mesh_count = compiled_static_mesh_count;
+	while ((p = AssetLookup::Mesh::names[Loader::compiled_static_mesh_count]))
+		Loader::compiled_static_mesh_count++;
+	Loader::static_mesh_count = Loader::compiled_static_mesh_count;
 
 	// load mod levels and meshes
 	{
@@ -118,12 +119,24 @@ void Loader::init(LoopSwapper* s)
 					mod_level_mesh_names.add(mod_level_mesh->string);
 					mod_level_mesh_paths.add(mod_level_mesh->valuestring);
 					mod_level_mesh = mod_level_mesh->next;
-					static_mesh_count++;
+					Loader::static_mesh_count++;
 				}
 			}
 		}
 		// don't free the json object; we'll read strings directly from it
 	}
+}
+
+void Loader::init(LoopSwapper* s)
+{
+	swapper = s;
+
+	// the server supervisor initializes once before forking match instances, which initialize again
+	if (!asset_counts_initialized)
+	{
+		asset_counts_init();
+		asset_counts_initialized = true;
+	}
 
 	RenderSync* sync = swapper->get();
 	s32 i = 0;
@@ -182,6 +195,7 @@ void Loader::settings_load(s32 default_width, s32 default_height)
 	Settings::framerate_limit = vi_max(30, Json::get_s32(json, "framerate_limit", 120));
 	Settings::shadow_quality = (Settings::ShadowQuality)vi_max(0, vi_min(Json::get_s32(json, "shadow_quality", (s32)Settings::ShadowQuality::High), (s32)Settings::ShadowQuality::count - 1));
 	Settings::supersampling = (b8)Json::get_s32(json, "supersampling", 1);
+	Settings::tiled_lighting = (b8)Json::get_s32(json, "tiled_lighting", 1);
 
 	cJSON* gamepads = json ? cJSON_GetObjectItem(json, "gamepads") : nullptr;
 	cJSON* gamepad = gamepads ? gamepads->child : nullptr;
@@ -229,6 +243,7 @@ void Loader::settings_save()
 	cJSON_AddNumberToObject(json, "framerate_limit", Settings::framerate_limit);
 	cJSON_AddNumberToObject(json, "shadow_quality", (s32)Settings::shadow_quality);
 	cJSON_AddNumberToObject(json, "supersampling", (s32)Settings::supersampling);
+	cJSON_AddNumberToObject(json, "tiled_lighting", (s32)Settings::tiled_lighting);
 
 	cJSON* gamepads = cJSON_CreateArray();
 	cJSON_AddItemToObject(json, "gamepads", gamepads);
@@ -331,6 +346,7 @@ const Mesh* Loader::mesh(AssetID id)
 		Array<Attrib> extra_attribs;
 		Mesh* mesh = &meshes[id].data;
 		read_mesh(mesh, mesh_path(id), &extra_attribs);
+		mesh->attrib_count = 2 + extra_attribs.length;
 
 		// GL
 		RenderSync* sync = Loader::swapper->get();
@@ -947,6 +963,30 @@ void Loader::level_free(cJSON* json)
 	Json::json_free((cJSON*)json);
 }
 
+// load every mesh the level references and keep it for good.
+// the server supervisor does this before forking match instances, so they all share one copy.
+void Loader::level_meshes_permanent(AssetID id)
+{
+	cJSON* json = Json::load(level_path(id));
+	if (!json)
+		return;
+
+	cJSON* element = json->child;
+	while (element)
+	{
+		cJSON* meshes = cJSON_GetObjectItem(element, "meshes");
+		cJSON* mesh = meshes ? meshes->child : nullptr;
+		while (mesh)
+		{
+			mesh_permanent(find_mesh(mesh->valuestring));
+			mesh = mesh->next;
+		}
+		element = element->next;
+	}
+
+	Json::json_free(json);
+}
+
 cJSON* Loader::dialogue_tree(AssetID id)
 {
 	if (id == AssetNull)
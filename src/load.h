@@ -94,6 +94,7 @@ struct Loader
 
 	static cJSON* level(AssetID, b8 = true);
 	static void level_free(cJSON*);
+	static void level_meshes_permanent(AssetID);
 
 	static cJSON* dialogue_tree(AssetID);
 	static void dialogue_tree_free(cJSON*);
@@ -2,6 +2,7 @@
 #include "vi_assert.h"
 
 #include "render/views.h"
+#include "render/skinned_model.h"
 #include "render/render.h"
 #include "data/entity.h"
 #include "data/components.h"
@@ -17,6 +18,8 @@
 #include "noise.h"
 #include "settings.h"
 #include "game/team.h"
+#include "net.h"
+#include "console.h"
 
 #if DEBUG
 	#define DEBUG_RENDER 0
@@ -115,6 +118,311 @@ void render_shadows(LoopSync* sync, s32 fbo, const Camera& main_camera, const Ca
 	Game::draw_opaque(shadow_render_params);
 }
 
+#define MAX_TILE_LIGHTS 16 // lights per draw call; must match max_lights in point_light.glsl
+#define LIGHT_TILES_X 16
+#define LIGHT_TILES_Y 9
+#define MAX_LIGHTS_PER_TILE 64 // lights beyond this fall back to drawing a sphere
+#define TILED_LIGHTING_MIN_LIGHTS 4 // with fewer lights than this, spheres are cheaper
+
+struct PointLightDraw
+{
+	Vec3 pos;
+	Vec3 view_pos;
+	Vec3 color;
+	r32 radius;
+	s32 type;
+	b8 sphere;
+};
+
+struct LightTile
+{
+	StaticArray<u16, MAX_LIGHTS_PER_TILE> lights;
+	b8 merged;
+};
+
+// a rectangle of tiles which all have the same light list, drawn as one quad
+struct LightTileRect
+{
+	s32 x;
+	s32 y;
+	s32 width;
+	s32 height;
+};
+
+Array<PointLightDraw> point_light_draws;
+LightTile light_tiles[LIGHT_TILES_X * LIGHT_TILES_Y];
+StaticArray<LightTileRect, LIGHT_TILES_X * LIGHT_TILES_Y> light_tile_rects;
+
+void point_light_sphere(const RenderParams& render_params, const PointLightDraw& light)
+{
+	LoopSync* sync = render_params.sync;
+
+	Mat4 light_transform = Mat4::make_translation(light.pos);
+	light_transform.scale(Vec3(light.radius));
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::light_count);
+	sync->write(RenderDataType::S32);
+	sync->write<s32>(1);
+	sync->write<s32>(1);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::light_pos);
+	sync->write(RenderDataType::Vec3);
+	sync->write<s32>(1);
+	sync->write<Vec3>(light.view_pos);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::mvp);
+	sync->write(RenderDataType::Mat4);
+	sync->write<s32>(1);
+	sync->write<Mat4>(light_transform * render_params.view_projection);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::type);
+	sync->write(RenderDataType::S32);
+	sync->write<s32>(1);
+	sync->write<s32>(light.type);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::light_color);
+	sync->write(RenderDataType::Vec3);
+	sync->write<s32>(1);
+	sync->write<Vec3>(light.color);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::light_radius);
+	sync->write(RenderDataType::R32);
+	sync->write<s32>(1);
+	sync->write<r32>(light.radius);
+
+	sync->write(RenderOp::Mesh);
+	sync->write(RenderPrimitiveMode::Triangles);
+	sync->write(Asset::Mesh::sphere);
+}
+
+// conservative screen space bounds of a light in normalized device coordinates
+// returns false if it reaches behind the camera, in which case it could cover anything
+b8 point_light_ndc_bounds(const RenderParams& render_params, const PointLightDraw& light, Vec2* ndc_min, Vec2* ndc_max)
+{
+	*ndc_min = Vec2(FLT_MAX, FLT_MAX);
+	*ndc_max = Vec2(-FLT_MAX, -FLT_MAX);
+	for (s32 i = 0; i < 8; i++)
+	{
+		Vec3 corner = light.pos + Vec3(i & 1 ? light.radius : -light.radius, i & 2 ? light.radius : -light.radius, i & 4 ? light.radius : -light.radius);
+		Vec4 clip = render_params.view_projection * Vec4(corner, 1);
+		if (clip.w <= 0.0f)
+			return false;
+		Vec2 ndc = Vec2(clip.x, clip.y) / clip.w;
+		ndc_min->x = vi_min(ndc_min->x, ndc.x);
+		ndc_min->y = vi_min(ndc_min->y, ndc.y);
+		ndc_max->x = vi_max(ndc_max->x, ndc.x);
+		ndc_max->y = vi_max(ndc_max->y, ndc.y);
+	}
+	return true;
+}
+
+s32 light_tile_index(r32 ndc, s32 tiles)
+{
+	s32 index = (s32)((ndc * 0.5f + 0.5f) * tiles);
+	return vi_max(0, vi_min(tiles - 1, index));
+}
+
+b8 light_tiles_match(const LightTile& a, const LightTile& b)
+{
+	// lights are binned in order, so equal sets are equal lists
+	return !b.merged
+		&& a.lights.length == b.lights.length
+		&& memcmp(a.lights.data, b.lights.data, a.lights.length * sizeof(u16)) == 0;
+}
+
+// greedily merge neighboring tiles with identical light lists into rectangles.
+// returns the number of draw calls the rectangles will take.
+s32 light_tile_rects_build()
+{
+	light_tile_rects.length = 0;
+	for (s32 i = 0; i < LIGHT_TILES_X * LIGHT_TILES_Y; i++)
+		light_tiles[i].merged = false;
+
+	s32 draws = 0;
+	for (s32 y = 0; y < LIGHT_TILES_Y; y++)
+	{
+		for (s32 x = 0; x < LIGHT_TILES_X; x++)
+		{
+			const LightTile& tile = light_tiles[y * LIGHT_TILES_X + x];
+			if (tile.merged || tile.lights.length == 0)
+				continue;
+
+			s32 width = 1;
+			while (x + width < LIGHT_TILES_X && light_tiles_match(tile, light_tiles[y * LIGHT_TILES_X + x + width]))
+				width++;
+
+			s32 height = 1;
+			while (y + height < LIGHT_TILES_Y)
+			{
+				b8 row_matches = true;
+				for (s32 x2 = x; x2 < x + width && row_matches; x2++)
+					row_matches = light_tiles_match(tile, light_tiles[(y + height) * LIGHT_TILES_X + x2]);
+				if (!row_matches)
+					break;
+				height++;
+			}
+
+			for (s32 y2 = y; y2 < y + height; y2++)
+			{
+				for (s32 x2 = x; x2 < x + width; x2++)
+					light_tiles[y2 * LIGHT_TILES_X + x2].merged = true;
+			}
+
+			light_tile_rects.add({ x, y, width, height });
+			draws += (tile.lights.length + MAX_TILE_LIGHTS - 1) / MAX_TILE_LIGHTS;
+		}
+	}
+	return draws;
+}
+
+// bin lights into screen tiles, merge tiles with the same lights into rectangles,
+// then shade each rectangle with one full-screen-quad draw per MAX_TILE_LIGHTS lights.
+// every pixel reads the g-buffer once per batch instead of once per light.
+// if that takes more draws than drawing a sphere per light (a few lights covering the whole screen), we draw spheres instead.
+void point_lights_tiled(const RenderParams& render_params)
+{
+	LoopSync* sync = render_params.sync;
+
+	for (s32 i = 0; i < LIGHT_TILES_X * LIGHT_TILES_Y; i++)
+		light_tiles[i].lights.length = 0;
+
+	for (s32 i = 0; i < point_light_draws.length; i++)
+	{
+		PointLightDraw* light = &point_light_draws[i];
+		s32 x_min = 0;
+		s32 y_min = 0;
+		s32 x_max = LIGHT_TILES_X - 1;
+		s32 y_max = LIGHT_TILES_Y - 1;
+		Vec2 ndc_min;
+		Vec2 ndc_max;
+		if (point_light_ndc_bounds(render_params, *light, &ndc_min, &ndc_max))
+		{
+			if (ndc_max.x < -1.0f || ndc_max.y < -1.0f || ndc_min.x > 1.0f || ndc_min.y > 1.0f)
+				continue;
+			x_min = light_tile_index(ndc_min.x, LIGHT_TILES_X);
+			y_min = light_tile_index(ndc_min.y, LIGHT_TILES_Y);
+			x_max = light_tile_index(ndc_max.x, LIGHT_TILES_X);
+			y_max = light_tile_index(ndc_max.y, LIGHT_TILES_Y);
+		}
+
+		// make sure there's room in every tile before adding the light to any of them
+		for (s32 y = y_min; y <= y_max && !light->sphere; y++)
+		{
+			for (s32 x = x_min; x <= x_max; x++)
+			{
+				if (light_tiles[y * LIGHT_TILES_X + x].lights.length == MAX_LIGHTS_PER_TILE)
+				{
+					light->sphere = true;
+					break;
+				}
+			}
+		}
+		if (light->sphere)
+			continue;
+
+		for (s32 y = y_min; y <= y_max; y++)
+		{
+			for (s32 x = x_min; x <= x_max; x++)
+				light_tiles[y * LIGHT_TILES_X + x].lights.add(i);
+		}
+	}
+
+	{
+		s32 tiled_lights = 0;
+		for (s32 i = 0; i < point_light_draws.length; i++)
+		{
+			if (!point_light_draws[i].sphere)
+				tiled_lights++;
+		}
+		if (light_tile_rects_build() > tiled_lights)
+		{
+			for (s32 i = 0; i < point_light_draws.length; i++)
+				point_light_draws[i].sphere = true;
+			return;
+		}
+	}
+
+	sync->write<RenderOp>(RenderOp::CullMode);
+	sync->write<RenderCullMode>(RenderCullMode::Back);
+
+	Vec3 positions[MAX_TILE_LIGHTS];
+	Vec3 colors[MAX_TILE_LIGHTS];
+	r32 radii[MAX_TILE_LIGHTS];
+	s32 types[MAX_TILE_LIGHTS];
+	Vec2 tile_size(2.0f / LIGHT_TILES_X, 2.0f / LIGHT_TILES_Y);
+	for (s32 r = 0; r < light_tile_rects.length; r++)
+	{
+		const LightTileRect& rect = light_tile_rects[r];
+		const LightTile& tile = light_tiles[rect.y * LIGHT_TILES_X + rect.x];
+
+		// map the full-screen quad onto this rectangle
+		Mat4 tile_transform = Mat4::make_translation(Vec3(-1.0f + (rect.x + rect.width * 0.5f) * tile_size.x, -1.0f + (rect.y + rect.height * 0.5f) * tile_size.y, 0));
+		tile_transform.scale(Vec3(tile_size.x * rect.width * 0.5f, tile_size.y * rect.height * 0.5f, 1.0f));
+
+		sync->write(RenderOp::Uniform);
+		sync->write(Asset::Uniform::mvp);
+		sync->write(RenderDataType::Mat4);
+		sync->write<s32>(1);
+		sync->write<Mat4>(tile_transform);
+
+		for (s32 start = 0; start < tile.lights.length; start += MAX_TILE_LIGHTS)
+		{
+			s32 count = vi_min(MAX_TILE_LIGHTS, tile.lights.length - start);
+			for (s32 i = 0; i < count; i++)
+			{
+				const PointLightDraw& light = point_light_draws[tile.lights[start + i]];
+				positions[i] = light.view_pos;
+				colors[i] = light.color;
+				radii[i] = light.radius;
+				types[i] = light.type;
+			}
+
+			sync->write(RenderOp::Uniform);
+			sync->write(Asset::Uniform::light_count);
+			sync->write(RenderDataType::S32);
+			sync->write<s32>(1);
+			sync->write<s32>(count);
+
+			sync->write(RenderOp::Uniform);
+			sync->write(Asset::Uniform::light_pos);
+			sync->write(RenderDataType::Vec3);
+			sync->write<s32>(count);
+			sync->write<Vec3>(positions, count);
+
+			sync->write(RenderOp::Uniform);
+			sync->write(Asset::Uniform::type);
+			sync->write(RenderDataType::S32);
+			sync->write<s32>(count);
+			sync->write<s32>(types, count);
+
+			sync->write(RenderOp::Uniform);
+			sync->write(Asset::Uniform::light_color);
+			sync->write(RenderDataType::Vec3);
+			sync->write<s32>(count);
+			sync->write<Vec3>(colors, count);
+
+			sync->write(RenderOp::Uniform);
+			sync->write(Asset::Uniform::light_radius);
+			sync->write(RenderDataType::R32);
+			sync->write<s32>(count);
+			sync->write<r32>(radii, count);
+
+			sync->write(RenderOp::Mesh);
+			sync->write(RenderPrimitiveMode::Triangles);
+			sync->write(screen_quad.mesh);
+		}
+	}
+
+	sync->write<RenderOp>(RenderOp::CullMode);
+	sync->write<RenderCullMode>(RenderCullMode::Front);
+}
+
 void render_point_lights(const RenderParams& render_params, s32 type_mask, const Vec2& inv_buffer_size, u16 team_mask)
 {
 	LoopSync* sync = render_params.sync;
@@ -163,7 +471,7 @@ void render_point_lights(const RenderParams& render_params, s32 type_mask, const
 	sync->write<s32>(4);
 	sync->write<Vec3>(render_params.camera->frustum_rays, 4);
 
-	Loader::mesh_permanent(Asset::Mesh::sphere);
+	point_light_draws.length = 0;
 	for (auto i = PointLight::list.iterator(); !i.is_last(); i.next())
 	{
 		PointLight* light = i.item();
@@ -178,45 +486,34 @@ void render_point_lights(const RenderParams& render_params, s32 type_mask, const
 		if (!render_params.camera->visible_sphere(light_pos, light->radius))
 			continue;
 
-		Mat4 light_transform = Mat4::make_translation(light_pos);
-		light_transform.scale(Vec3(light->radius));
-
-		sync->write(RenderOp::Uniform);
-		sync->write(Asset::Uniform::light_pos);
-		sync->write(RenderDataType::Vec3);
-		sync->write<s32>(1);
-		sync->write<Vec3>((render_params.view * Vec4(light_pos, 1)).xyz());
-
-		sync->write(RenderOp::Uniform);
-		sync->write(Asset::Uniform::mvp);
-		sync->write(RenderDataType::Mat4);
-		sync->write<s32>(1);
-		sync->write<Mat4>(light_transform * render_params.view_projection);
-
-		sync->write(RenderOp::Uniform);
-		sync->write(Asset::Uniform::type);
-		sync->write(RenderDataType::S32);
-		sync->write<s32>(1);
-		sync->write<s32>((s32)light->type);
-
-		sync->write(RenderOp::Uniform);
-		sync->write(Asset::Uniform::light_color);
-		sync->write(RenderDataType::Vec3);
-		sync->write<s32>(1);
+		PointLightDraw* draw = point_light_draws.add();
+		draw->pos = light_pos;
+		draw->view_pos = (render_params.view * Vec4(light_pos, 1)).xyz();
 		if (light->team == (u8)AI::TeamNone)
-			sync->write<Vec3>(light->color);
+			draw->color = light->color;
 		else
-			sync->write<Vec3>(Team::color((AI::Team)render_params.camera->team, (AI::Team)light->team).xyz());
+			draw->color = Team::color((AI::Team)render_params.camera->team, (AI::Team)light->team).xyz();
+		draw->radius = light->radius;
+		draw->type = (s32)light->type;
+		draw->sphere = false;
+	}
 
-		sync->write(RenderOp::Uniform);
-		sync->write(Asset::Uniform::light_radius);
-		sync->write(RenderDataType::R32);
-		sync->write<s32>(1);
-		sync->write<r32>(light->radius);
+	// override lights discard pixels, so they have to be drawn one at a time
+	if (Settings::tiled_lighting
+		&& !(type_mask & (s32)PointLight::Type::Override)
+		&& point_light_draws.length >= TILED_LIGHTING_MIN_LIGHTS)
+		point_lights_tiled(render_params);
+	else
+	{
+		for (s32 i = 0; i < point_light_draws.length; i++)
+			point_light_draws[i].sphere = true;
+	}
 
-		sync->write(RenderOp::Mesh);
-		sync->write(RenderPrimitiveMode::Triangles);
-		sync->write(Asset::Mesh::sphere);
+	Loader::mesh_permanent(Asset::Mesh::sphere);
+	for (s32 i = 0; i < point_light_draws.length; i++)
+	{
+		if (point_light_draws[i].sphere)
+			point_light_sphere(render_params, point_light_draws[i]);
 	}
 }
 
@@ -1431,12 +1728,98 @@ void draw(LoopSync* sync, const Camera* camera)
 	sync->write(true);
 }
 
+#if SERVER
+#define SERVER_MAX_CATCH_UP_TICKS 4 // if we fall further behind than this, drop ticks instead of trying to catch up
+#define SERVER_STATS_INTERVAL 10.0 // seconds between tick timing reports
+
+// fixed-rate, deadline-based tick scheduler for dedicated servers
+struct TickScheduler
+{
+	r64 next_tick;
+	r64 last_report;
+	r64 work_total;
+	r64 work_max;
+	r64 lateness_max;
+	s32 ticks;
+	s32 late_ticks;
+	s32 skipped_ticks;
+
+	TickScheduler(r64 now)
+		: next_tick(now),
+		last_report(now),
+		work_total(),
+		work_max(),
+		lateness_max(),
+		ticks(),
+		late_ticks(),
+		skipped_ticks()
+	{
+	}
+
+	// block until the next tick deadline
+	void wait()
+	{
+		r64 now = platform::time();
+		if (now < next_tick)
+		{
+			platform::sleep((r32)(next_tick - now));
+			now = platform::time();
+		}
+
+		r64 lateness = now - next_tick;
+		lateness_max = vi_max(lateness_max, lateness);
+		if (lateness > TICK_RATE * SERVER_MAX_CATCH_UP_TICKS)
+		{
+			// we're too far behind; skip the missed ticks and start over from now
+			skipped_ticks += (s32)(lateness / TICK_RATE);
+			next_tick = now;
+		}
+		else if (lateness > TICK_RATE)
+			late_ticks++; // catch up by running the next tick immediately
+
+		next_tick += TICK_RATE;
+	}
+
+	// record how long the tick took to process
+	void done(r64 work)
+	{
+		ticks++;
+		work_total += work;
+		work_max = vi_max(work_max, work);
+
+		r64 now = platform::time();
+		if (now - last_report > SERVER_STATS_INTERVAL)
+		{
+			printf("Ticks: %d | Work avg: %.2fms max: %.2fms | Lateness max: %.2fms | Late: %d | Skipped: %d\n",
+				ticks,
+				(r32)((work_total / vi_max(ticks, 1)) * 1000.0),
+				(r32)(work_max * 1000.0),
+				(r32)(lateness_max * 1000.0),
+				late_ticks,
+				skipped_ticks);
+			last_report = now;
+			work_total = 0.0;
+			work_max = 0.0;
+			lateness_max = 0.0;
+			ticks = 0;
+			late_ticks = 0;
+			skipped_ticks = 0;
+		}
+	}
+};
+#endif
+
 void loop(LoopSwapper* swapper_render, PhysicsSwapper* swapper_physics)
 {
 	mersenne::srand(platform::timestamp());
 	noise::reseed();
 
+#if SERVER
+	// the server has no render thread, so we hang on to a single LoopSync and never swap it
+	LoopSync* sync_render = swapper_render->get();
+#else
 	LoopSync* sync_render = swapper_render->swap<SwapType_Write>();
+#endif
 
 	Loader::init(swapper_render);
 
@@ -1531,25 +1914,32 @@ void loop(LoopSwapper* swapper_render, PhysicsSwapper* swapper_physics)
 	Update u;
 	u.input = &sync_render->input;
 	u.last_input = &last_input;
+	u.time = GameTime();
 
 	PhysicsSync* sync_physics = nullptr;
 
+#if SERVER
+	TickScheduler scheduler(platform::time());
+#else
 	r32 time_update = 0.0f; // time required for update
+#endif
 
 	while (!sync_render->quit && !Game::quit)
 	{
 		// Update
 
-		{
-			// limit framerate
-
-			r32 framerate_limit;
 #if SERVER
-			framerate_limit = Settings::framerate_limit;
-#else
-			framerate_limit = u.input->focus ? Settings::framerate_limit : 30;
-#endif
+		if (!Net::replay_path) // replays run as fast as they can
+			scheduler.wait();
+
+		r64 time_update_start = platform::time();
 
+		u.time.delta = TICK_RATE;
+		u.time.total += TICK_RATE;
+#else
+		{
+			// limit framerate
+			r32 framerate_limit = u.input->focus ? Settings::framerate_limit : 30;
 			r32 delay = (1.0f / framerate_limit) - time_update;
 			if (delay > 0)
 				platform::sleep(delay);
@@ -1557,8 +1947,9 @@ void loop(LoopSwapper* swapper_render, PhysicsSwapper* swapper_physics)
 
 		r64 time_update_start = platform::time();
 
-		u.input = &sync_render->input;
 		u.time = sync_render->time;
+#endif
+		u.input = &sync_render->input;
 
 #if DEBUG
 		if (u.input->keys[(s32)KeyCode::F5])
@@ -1581,20 +1972,30 @@ void loop(LoopSwapper* swapper_render, PhysicsSwapper* swapper_physics)
 		sync_render->write(true);
 		sync_render->write(true);
 
+		// nothing moves while we draw, so compute world transforms and culling hierarchies once for every camera
+		Transform::cache_build();
+		View::cull_build();
+		SkinnedModel::cull_build();
 		for (s32 i = 0; i < Camera::max_cameras; i++)
 		{
 			if (Camera::list[i].active)
 				draw(sync_render, &Camera::list[i]);
 		}
+		Transform::cache_clear();
 #endif
 
 		sync_render->quit |= Game::quit;
 
 		memcpy(&last_input, &sync_render->input, sizeof(last_input));
 
+#if SERVER
+		scheduler.done(platform::time() - time_update_start);
+#else
 		time_update = (r32)(platform::time() - time_update_start);
 
 		sync_render = swapper_render->swap<SwapType_Write>();
+		Console::render_stats = sync_render->stats;
+#endif
 		sync_render->queue.length = 0;
 	}
 
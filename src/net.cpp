@@ -4,6 +4,7 @@
 #include "game/game.h"
 #if SERVER
 #include "asset/level.h"
+#include "game/entities.h"
 #endif
 #include "mersenne/mersenne-twister.h"
 #include "common.h"
@@ -20,11 +21,26 @@
 #include "game/minion.h"
 #include "game/ai_player.h"
 #include "assimp/contrib/zlib/zlib.h"
+#include "fastlz/fastlz.h"
+#include "platform/util.h"
+#include "sync.h"
+#include <thread>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #define DEBUG_MSG 0
 #define DEBUG_ENTITY 0
 #define DEBUG_TRANSFORMS 1
 #define DEBUG_BANDWIDTH 1
+#define DEBUG_COMPRESSION 0
+
+#define NET_COMPRESSION_ZLIB 0
+#define NET_COMPRESSION_FASTLZ 1
+#define NET_COMPRESSION NET_COMPRESSION_ZLIB
+
+#define NET_THREAD 1 // receive on a dedicated thread rather than polling the socket from the game thread
+#define NET_QUEUE_SIZE 256 // incoming datagrams buffered between the network thread and the game thread
 
 namespace VI
 {
@@ -38,13 +54,20 @@ namespace Net
 typedef u8 SequenceID;
 
 #define TIMEOUT 2.0f
-#define TICK_RATE (1.0f / 60.0f)
 #define SEQUENCE_BITS 8
 #define SEQUENCE_COUNT (1 << SEQUENCE_BITS)
 
 #define MESSAGE_BUFFER s32(TIMEOUT / TICK_RATE)
 #define MAX_MESSAGES_SIZE (MAX_PACKET_SIZE / 2)
-#define INTERPOLATION_DELAY 0.085f
+#define INTERPOLATION_DELAY 0.085f // starting point; the client adapts it to the connection
+#define INTERPOLATION_DELAY_MAX 0.25f
+#define INTERPOLATION_DELAY_SLEW 0.1f // max change in delay per second, so playback speed stays within 10% of normal
+#define INTERPOLATION_JITTER_SCALE 3.0f // how many mean deviations of arrival jitter to buffer against
+#define JITTER_SMOOTHING (1.0f / 16.0f)
+#define EXTRAPOLATION_MAX 0.1f // how long to keep extrapolating when we run out of frames
+#define COMMAND_BUFFER 128 // input commands the client holds on to until the server acknowledges them
+#define COMMAND_REDUNDANCY 16 // most recent commands sent with every packet, in case some get lost
+#define COMMAND_DT_MAX 0.1f // longest time step a single command can simulate
 
 enum class ClientPacket
 {
@@ -85,13 +108,20 @@ struct MessageFrame // container for the amount of messages that can come in a s
 	~MessageFrame() {}
 };
 
+#define TRANSFORM_POS_BITS 50 // see serialize_position
+#define TRANSFORM_ROT_BITS 29 // see serialize_quat
+
+// a transform quantized exactly as it goes over the wire.
+// bits are packed in the order the serialize functions write them.
 struct TransformState
 {
-	Vec3 pos;
-	Quat rot;
+	u64 pos;
+	u32 rot;
 	Ref<Transform> parent;
 };
 
+// every transform at one point in time, indexed by ID.
+// only used as scratch space while building, reading, writing, and interpolating frames.
 struct TransformFrame
 {
 	TransformState transforms[MAX_ENTITIES];
@@ -101,10 +131,21 @@ struct TransformFrame
 	u16 count;
 };
 
+// compact copy of a TransformFrame containing only the active transforms, in ID order
+struct TransformSnapshot
+{
+	Array<ID> indices;
+	Array<TransformState> transforms;
+	r32 timestamp;
+	SequenceID sequence_id;
+	b8 valid;
+};
+
 struct TransformHistory
 {
-	StaticArray<TransformFrame, 256> frames;
-	s32 current_index;
+	TransformSnapshot snapshots[SEQUENCE_COUNT]; // indexed by sequence ID
+	SequenceID most_recent;
+	b8 empty = true;
 };
 
 struct Ack
@@ -235,6 +276,9 @@ template<typename Stream> b8 serialize_entity(Stream* p, Entity* e)
 		{
 			serialize_int(p, ID, e->components[i], 0, MAX_ENTITIES - 1);
 			ID component_id = e->components[i];
+			// pools are sized per component type, so the ID range alone doesn't keep us in bounds
+			if (Stream::IsReading && (i >= World::families || component_id >= World::component_pools[i]->capacity()))
+				net_error();
 			Revision r;
 			if (Stream::IsWriting)
 				r = World::component_pools[i]->revision(component_id);
@@ -630,6 +674,120 @@ r32 tick_timer;
 Sock::Handle sock;
 SequenceID local_sequence_id = 1;
 
+// setting up a zlib stream allocates a few hundred KB, so we keep one deflate and one inflate stream around
+// and reset them between packets. every packet is still compressed independently,
+// since packets can arrive out of order or not at all.
+struct Compressor
+{
+	z_stream deflater;
+	z_stream inflater;
+#if DEBUG_COMPRESSION
+	r64 time;
+	s32 bytes_in;
+	s32 bytes_out;
+	s32 packets;
+#endif
+};
+
+Compressor compressor;
+
+void compressor_init()
+{
+#if NET_COMPRESSION == NET_COMPRESSION_ZLIB
+	memset(&compressor.deflater, 0, sizeof(compressor.deflater));
+	s32 result = deflateInit(&compressor.deflater, Z_DEFAULT_COMPRESSION);
+	vi_assert(result == Z_OK);
+
+	memset(&compressor.inflater, 0, sizeof(compressor.inflater));
+	result = inflateInit(&compressor.inflater);
+	vi_assert(result == Z_OK);
+#endif
+}
+
+void compressor_term()
+{
+#if NET_COMPRESSION == NET_COMPRESSION_ZLIB
+	deflateEnd(&compressor.deflater);
+	inflateEnd(&compressor.inflater);
+#endif
+}
+
+#if DEBUG_COMPRESSION
+void compressor_stats(r64 start_time, s32 bytes_in, s32 bytes_out)
+{
+	compressor.time += platform::time() - start_time;
+	compressor.bytes_in += bytes_in;
+	compressor.bytes_out += bytes_out;
+	compressor.packets++;
+	if (compressor.packets == 1000)
+	{
+		vi_debug("Compression: %d packets, %d -> %d bytes (%.1f%%), %.2fus per packet", compressor.packets, compressor.bytes_in, compressor.bytes_out, 100.0f * r32(compressor.bytes_out) / r32(compressor.bytes_in), r32(compressor.time * 1000000.0 / compressor.packets));
+		compressor.time = 0.0;
+		compressor.bytes_in = 0;
+		compressor.bytes_out = 0;
+		compressor.packets = 0;
+	}
+}
+#endif
+
+// returns the compressed size, or -1 if it doesn't fit in out_capacity
+s32 compress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+#if DEBUG_COMPRESSION
+	r64 start_time = platform::time();
+#endif
+
+#if NET_COMPRESSION == NET_COMPRESSION_FASTLZ
+	// fastlz needs 5% extra room for incompressible data
+	u8 buffer[MAX_PACKET_SIZE * 2];
+	s32 out_bytes = fastlz_compress_level(1, in, in_bytes, buffer);
+	if (out_bytes > out_capacity)
+		out_bytes = -1;
+	else
+		memcpy(out, buffer, out_bytes);
+#else
+	z_stream* z = &compressor.deflater;
+	s32 result = deflateReset(z);
+	vi_assert(result == Z_OK);
+	z->next_out = (Bytef*)out;
+	z->avail_out = out_capacity;
+	z->next_in = (Bytef*)in;
+	z->avail_in = in_bytes;
+
+	result = deflate(z, Z_FINISH);
+	s32 out_bytes = result == Z_STREAM_END ? s32(out_capacity - z->avail_out) : -1;
+#endif
+
+#if DEBUG_COMPRESSION
+	compressor_stats(start_time, in_bytes, out_bytes < 0 ? in_bytes : out_bytes);
+#endif
+
+	return out_bytes;
+}
+
+// returns the decompressed size, or -1 if the data is invalid
+s32 decompress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+#if NET_COMPRESSION == NET_COMPRESSION_FASTLZ
+	s32 out_bytes = fastlz_decompress(in, in_bytes, out, out_capacity);
+	return out_bytes > 0 ? out_bytes : -1;
+#else
+	z_stream* z = &compressor.inflater;
+	s32 result = inflateReset(z);
+	vi_assert(result == Z_OK);
+	z->next_in = (Bytef*)in;
+	z->avail_in = in_bytes;
+	z->next_out = (Bytef*)out;
+	z->avail_out = out_capacity;
+
+	result = inflate(z, Z_FINISH);
+	if (result != Z_STREAM_END)
+		return -1;
+
+	return out_capacity - z->avail_out;
+#endif
+}
+
 void packet_init(StreamWrite* p)
 {
 	p->bits(NET_PROTOCOL_ID, 32); // packet_send() will replace this with the packet checksum
@@ -645,64 +803,381 @@ void packet_finalize(StreamWrite* p)
 	p->data[0] = checksum;
 
 	StreamWrite compressed;
-	compressed.resize_bytes(MAX_PACKET_SIZE);
-	z_stream z;
-	z.zalloc = nullptr;
-	z.zfree = nullptr;
-	z.opaque = nullptr;
-	z.next_out = (Bytef*)compressed.data.data;
-	z.avail_out = MAX_PACKET_SIZE;
-	z.next_in = (Bytef*)p->data.data;
-	z.avail_in = p->bytes_written();
-
-	s32 result = deflateInit(&z, Z_DEFAULT_COMPRESSION);
-	vi_assert(result == Z_OK);
-
-	result = deflate(&z, Z_FINISH);
-
-	vi_assert(result == Z_STREAM_END && z.avail_in == 0);
-
-	result = deflateEnd(&z);
-	vi_assert(result == Z_OK);
+	s32 bytes = p->bytes_written();
+	s32 compressed_bytes = compress((const u8*)p->data.data, bytes, (u8*)compressed.data.data, MAX_PACKET_SIZE);
+	if (compressed_bytes < 0 || compressed_bytes >= bytes)
+	{
+		// incompressible; send it as is. see packet_decompress
+		return;
+	}
 
 	p->reset();
-	p->resize_bytes(MAX_PACKET_SIZE - z.avail_out);
+	p->resize_bytes(compressed_bytes);
 	if (p->data.length > 0)
 	{
 		p->data[p->data.length - 1] = 0; // make sure everything gets zeroed out so the CRC32 comes out right
-		memcpy(p->data.data, compressed.data.data, MAX_PACKET_SIZE - z.avail_out);
+		memcpy(p->data.data, compressed.data.data, compressed_bytes);
 	}
 }
 
-void packet_decompress(StreamRead* p, s32 bytes)
+// packets which didn't compress are sent as is, and they carry a valid checksum as they are.
+// compressed data only has a 1 in 2^32 chance of passing for one, so no header is needed to tell them apart.
+b8 packet_decompress(StreamRead* p, s32 bytes)
 {
-	StreamRead decompressed;
-	decompressed.resize_bytes(bytes);
-	
-	z_stream z;
-	z.zalloc = nullptr;
-	z.zfree = nullptr;
-	z.opaque = nullptr;
-	z.next_in = (Bytef*)p->data.data;
-	z.avail_in = bytes;
-	z.next_out = (Bytef*)decompressed.data.data;
-	z.avail_out = MAX_PACKET_SIZE;
-
-	s32 result = inflateInit(&z);
-	vi_assert(result == Z_OK);
-	
-	result = inflate(&z, Z_NO_FLUSH);
-	vi_assert(result == Z_STREAM_END);
+	if (bytes >= s32(sizeof(u32)))
+	{
+		// the checksum covers whole words; zero out whatever trails the datagram in the last one
+		for (s32 i = bytes; i < s32(p->data.length * sizeof(u32)); i++)
+			((u8*)p->data.data)[i] = 0;
+		b8 raw = p->read_checksum();
+		p->rewind();
+		if (raw)
+			return true;
+	}
 
-	result = inflateEnd(&z);
-	vi_assert(result == Z_OK);
+	StreamRead decompressed;
+	s32 decompressed_bytes = decompress((const u8*)p->data.data, bytes, (u8*)decompressed.data.data, MAX_PACKET_SIZE);
+	if (decompressed_bytes < 0)
+		return false;
 
 	p->reset();
-	p->resize_bytes(MAX_PACKET_SIZE - z.avail_out);
+	p->resize_bytes(decompressed_bytes);
 	if (p->data.length > 0)
 	{
 		p->data[p->data.length - 1] = 0; // make sure everything is zeroed out so the CRC32 comes out right
-		memcpy(p->data.data, decompressed.data.data, MAX_PACKET_SIZE - z.avail_out);
+		memcpy(p->data.data, decompressed.data.data, decompressed_bytes);
+	}
+	return true;
+}
+
+// outgoing packets are batched and flushed at the end of every update, one syscall per batch on Linux.
+// incoming packets are drained in batches on the network thread and handed to the game thread through a lock-free queue.
+struct PacketIO
+{
+	StaticArray<Sock::Datagram, SOCK_BATCH> outgoing;
+#if NET_THREAD
+	SyncQueue<Sock::Datagram, NET_QUEUE_SIZE> incoming;
+	std::thread thread;
+	std::atomic<b8> quit;
+	std::atomic<s32> dropped; // incoming datagrams discarded because the game thread fell behind
+#endif
+};
+
+PacketIO io;
+
+// traffic capture and replay.
+// a capture is a header followed by one record per datagram, exactly as it went over the wire.
+// replaying feeds the incoming datagrams back through packet_handle on their original schedule,
+// without a socket and without waiting for real time, then reports how the server held up.
+// the file format is in net_serialize.h.
+#define CAPTURE_MAX_PEERS 64
+
+struct CapturePeer
+{
+	Sock::Address address;
+	s64 bytes_in;
+	s64 bytes_out;
+	s32 packets_in;
+	s32 packets_out;
+};
+
+struct Capture
+{
+	FILE* record;
+	FILE* replay;
+	CaptureRecord next; // next incoming datagram in the replay
+	u8 next_data[SOCK_MAX_DATAGRAM];
+	b8 next_valid;
+	r32 end_time; // when the last incoming datagram was replayed
+	StaticArray<CapturePeer, CAPTURE_MAX_PEERS> peers;
+	r64 start;
+	r64 last_tick;
+	r64 tick_total;
+	r64 tick_max;
+	s32 ticks;
+	s64 heap_start;
+	s64 heap_max;
+};
+
+Capture capture;
+const char* capture_path;
+const char* replay_path;
+
+s64 heap_in_use()
+{
+#if defined(__GLIBC__)
+#if __GLIBC_PREREQ(2, 33)
+	struct mallinfo2 info = mallinfo2();
+	return s64(info.uordblks + info.hblkhd);
+#else
+	return 0;
+#endif
+#else
+	return 0;
+#endif
+}
+
+CapturePeer* capture_peer(const Sock::Address& address)
+{
+	for (s32 i = 0; i < capture.peers.length; i++)
+	{
+		if (capture.peers[i].address.equals(address))
+			return &capture.peers[i];
+	}
+	if (capture.peers.length == capture.peers.capacity())
+		return nullptr;
+	CapturePeer* peer = capture.peers.add();
+	memset(peer, 0, sizeof(*peer));
+	peer->address = address;
+	return peer;
+}
+
+void capture_write(CaptureDirection direction, const Sock::Address& address, const void* data, s32 size)
+{
+	CaptureRecord record = {};
+	record.timestamp = Game::real_time.total;
+	record.host = address.host;
+	record.port = address.port;
+	record.direction = direction;
+	record.size = size;
+	fwrite(&record, sizeof(record), 1, capture.record);
+	fwrite(data, size, 1, capture.record);
+}
+
+// read ahead to the next incoming datagram
+void replay_advance()
+{
+	capture.next_valid = false;
+	CaptureRecord record;
+	while (fread(&record, sizeof(record), 1, capture.replay) == 1)
+	{
+		if (record.size < 0 || record.size > SOCK_MAX_DATAGRAM)
+			break; // corrupt
+		if (record.direction == CaptureDirection::In)
+		{
+			if (fread(capture.next_data, record.size, 1, capture.replay) != 1 && record.size > 0)
+				break;
+			capture.next = record;
+			capture.next_valid = true;
+			return;
+		}
+		fseek(capture.replay, record.size, SEEK_CUR);
+	}
+}
+
+b8 capture_open()
+{
+	if (capture_path)
+	{
+		capture.record = fopen(capture_path, "wb");
+		if (!capture.record)
+		{
+			fprintf(stderr, "Can't open capture file %s for writing.\n", capture_path);
+			return false;
+		}
+		u32 header[2] = { CAPTURE_MAGIC, CAPTURE_VERSION };
+		fwrite(header, sizeof(header), 1, capture.record);
+	}
+
+	if (replay_path)
+	{
+		capture.replay = fopen(replay_path, "rb");
+		u32 header[2];
+		if (!capture.replay
+			|| fread(header, sizeof(header), 1, capture.replay) != 1
+			|| header[0] != CAPTURE_MAGIC
+			|| header[1] != CAPTURE_VERSION)
+		{
+			fprintf(stderr, "Can't read capture file %s.\n", replay_path);
+			return false;
+		}
+		replay_advance();
+		capture.start = platform::time();
+		capture.heap_start = capture.heap_max = heap_in_use();
+	}
+
+	return true;
+}
+
+void replay_report()
+{
+	r64 elapsed = platform::time() - capture.start;
+	printf("Replayed %.1fs of traffic in %.1fs (%.1fx)\n", Game::real_time.total, elapsed, Game::real_time.total / vi_max(elapsed, 0.001));
+	printf("Ticks: %d | Work avg: %.3fms max: %.3fms\n",
+		capture.ticks,
+		r32((capture.tick_total / vi_max(capture.ticks, 1)) * 1000.0),
+		r32(capture.tick_max * 1000.0));
+	printf("Heap: %lldKB at start, %lldKB peak, %lldKB at end\n",
+		(long long)(capture.heap_start / 1024),
+		(long long)(capture.heap_max / 1024),
+		(long long)(heap_in_use() / 1024));
+	for (s32 i = 0; i < capture.peers.length; i++)
+	{
+		const CapturePeer& peer = capture.peers[i];
+		printf("%s:%hu | In: %d packets, %lldB | Out: %d packets, %lldB (%.1fB/tick)\n",
+			Sock::host_to_str(peer.address.host),
+			peer.address.port,
+			peer.packets_in,
+			(long long)peer.bytes_in,
+			peer.packets_out,
+			(long long)peer.bytes_out,
+			r32(r64(peer.bytes_out) / r64(vi_max(capture.ticks, 1))));
+	}
+}
+
+// called once per update while replaying.
+// we never sleep, so the time between updates is exactly how long the last one took.
+void replay_update()
+{
+	r64 now = platform::time();
+	if (capture.ticks > 0)
+	{
+		r64 work = now - capture.last_tick;
+		capture.tick_total += work;
+		capture.tick_max = vi_max(capture.tick_max, work);
+	}
+	capture.last_tick = now;
+	capture.ticks++;
+	capture.heap_max = vi_max(capture.heap_max, heap_in_use());
+
+	if (capture.next_valid)
+		capture.end_time = Game::real_time.total;
+	else if (Game::real_time.total - capture.end_time > TIMEOUT) // give the clients time to time out
+	{
+		replay_report();
+		Game::quit = true;
+	}
+}
+
+void capture_close()
+{
+	if (capture.record)
+	{
+		fclose(capture.record);
+		capture.record = nullptr;
+	}
+	if (capture.replay)
+	{
+		fclose(capture.replay);
+		capture.replay = nullptr;
+	}
+}
+
+#if NET_THREAD
+void io_loop()
+{
+	Sock::Datagram batch[SOCK_BATCH];
+	while (!io.quit.load())
+	{
+		if (Sock::udp_wait(&sock, 0.1f) <= 0)
+			continue;
+
+		s32 received;
+		while ((received = Sock::udp_receive_batch(&sock, batch, SOCK_BATCH)) > 0)
+		{
+			for (s32 i = 0; i < received; i++)
+			{
+				Sock::Datagram* datagram = io.incoming.write_begin();
+				if (!datagram)
+				{
+					io.dropped++;
+					continue;
+				}
+				datagram->address = batch[i].address;
+				datagram->size = batch[i].size;
+				memcpy(datagram->data, batch[i].data, batch[i].size);
+				io.incoming.write_end();
+			}
+		}
+	}
+}
+#endif
+
+void io_start()
+{
+#if NET_THREAD
+	if (capture.replay)
+		return;
+	io.quit = false;
+	io.dropped = 0;
+	io.thread = std::thread(&io_loop);
+#endif
+}
+
+void io_stop()
+{
+#if NET_THREAD
+	io.quit = true;
+	if (io.thread.joinable())
+		io.thread.join();
+#endif
+}
+
+s32 packet_receive_socket(Sock::Address* address, StreamRead* p)
+{
+#if NET_THREAD
+	Sock::Datagram* datagram = io.incoming.read_begin();
+	if (!datagram)
+		return 0;
+	*address = datagram->address;
+	s32 bytes = vi_min(datagram->size, MAX_PACKET_SIZE);
+	memcpy(p->data.data, datagram->data, bytes);
+	io.incoming.read_end();
+	return bytes;
+#else
+	return Sock::udp_receive(&sock, address, p->data.data, MAX_PACKET_SIZE);
+#endif
+}
+
+s32 packet_receive(Sock::Address* address, StreamRead* p)
+{
+	s32 bytes;
+	if (capture.replay)
+	{
+		if (!capture.next_valid || capture.next.timestamp > Game::real_time.total)
+			return 0;
+		address->host = capture.next.host;
+		address->port = capture.next.port;
+		bytes = vi_min(capture.next.size, MAX_PACKET_SIZE);
+		memcpy(p->data.data, capture.next_data, bytes);
+		replay_advance();
+		if (CapturePeer* peer = capture_peer(*address))
+		{
+			peer->packets_in++;
+			peer->bytes_in += bytes;
+		}
+	}
+	else
+		bytes = packet_receive_socket(address, p);
+
+	if (bytes > 0 && capture.record)
+		capture_write(CaptureDirection::In, *address, p->data.data, bytes);
+	return bytes;
+}
+
+void packet_flush()
+{
+	if (io.outgoing.length > 0)
+	{
+		if (capture.replay)
+		{
+			// nobody is listening; just keep count
+			for (s32 i = 0; i < io.outgoing.length; i++)
+			{
+				if (CapturePeer* peer = capture_peer(io.outgoing[i].address))
+				{
+					peer->packets_out++;
+					peer->bytes_out += io.outgoing[i].size;
+				}
+			}
+		}
+		else
+		{
+			s32 sent = Sock::udp_send_batch(&sock, io.outgoing.data, io.outgoing.length);
+			if (sent < io.outgoing.length)
+				vi_debug("Dropped %d of %d outgoing packets: %s", s32(io.outgoing.length) - sent, s32(io.outgoing.length), Sock::get_error());
+		}
+		io.outgoing.length = 0;
 	}
 }
 
@@ -711,7 +1186,15 @@ void packet_send(const StreamWrite& p, const Sock::Address& address)
 #if DEBUG_BANDWIDTH
 	vi_debug("Outgoing packet size: %dB", p.bytes_written());
 #endif
-	Sock::udp_send(&sock, address, p.data.data, p.bytes_written());
+	vi_assert(p.bytes_written() <= SOCK_MAX_DATAGRAM);
+	if (io.outgoing.length == io.outgoing.capacity())
+		packet_flush();
+	Sock::Datagram* datagram = io.outgoing.add();
+	datagram->address = address;
+	datagram->size = p.bytes_written();
+	memcpy(datagram->data, p.data.data, datagram->size);
+	if (capture.record)
+		capture_write(CaptureDirection::Out, address, datagram->data, datagram->size);
 }
 
 b8 msg_send_noop()
@@ -903,10 +1386,14 @@ void calculate_rtt(r32 timestamp, const Ack& ack, const MessageHistory& send_his
 		*rtt = (*rtt * 0.9f) + (new_rtt * 0.1f);
 }
 
-b8 msgs_read(StreamRead* p, MessageHistory* history, Ack* ack)
+// frame_count, if given, receives the number of message frames in the packet
+b8 msgs_read(StreamRead* p, MessageHistory* history, Ack* ack, s32* frame_count = nullptr)
 {
 	using Stream = StreamRead;
 
+	if (frame_count)
+		*frame_count = 0;
+
 	Ack ack_candidate;
 	serialize_int(p, SequenceID, ack_candidate.sequence_id, 0, SEQUENCE_COUNT - 1);
 	serialize_u32(p, ack_candidate.previous_sequences);
@@ -924,6 +1411,8 @@ b8 msgs_read(StreamRead* p, MessageHistory* history, Ack* ack)
 			serialize_int(p, SequenceID, frame->sequence_id, 0, SEQUENCE_COUNT - 1);
 			frame->read.resize_bytes(bytes);
 			serialize_bytes(p, (u8*)frame->read.data.data, bytes);
+			if (frame_count)
+				(*frame_count)++;
 		}
 		else
 			break;
@@ -983,214 +1472,698 @@ template<typename Stream> b8 serialize_quat(Stream* p, Quat* rot)
 	return true;
 }
 
-template<typename Stream> b8 serialize_transform(Stream* p, TransformState* transform)
+template<typename Stream> b8 serialize_position(Stream* p, Vec3* pos)
 {
-	serialize_r32_range(p, transform->pos.x, -256, 256, 18);
-	serialize_r32_range(p, transform->pos.y, -32, 128, 14);
-	serialize_r32_range(p, transform->pos.z, -256, 256, 18);
-	if (!serialize_quat(p, &transform->rot))
-		net_error();
-	serialize_ref(p, transform->parent);
+	serialize_r32_range(p, pos->x, -256, 256, 18);
+	serialize_r32_range(p, pos->y, -32, 128, 14);
+	serialize_r32_range(p, pos->z, -256, 256, 18);
 	return true;
 }
 
-b8 transform_frame_write(StreamWrite* p, TransformFrame* frame, const TransformFrame* base)
+// stand-ins for StreamWrite and StreamRead which pack quantized values into an integer
+// rather than a packet, so the serialize functions define the quantization in one place
+struct QuantizeWrite
 {
-	using Stream = StreamWrite;
-	serialize_int(p, SequenceID, frame->sequence_id, 0, SEQUENCE_COUNT - 1);
-	serialize_int(p, u16, frame->count, 0, MAX_ENTITIES - 1);
-	s32 index = s32(frame->active.start);
-	for (s32 i = 0; i < frame->count; i++)
+	enum { IsWriting = 1 };
+	enum { IsReading = 0 };
+
+	u64 value;
+	s32 bit_count;
+
+	QuantizeWrite() : value(), bit_count() {}
+
+	b8 would_overflow(s32) const
 	{
-		serialize_int(p, s32, index, 0, MAX_ENTITIES - 1);
-		if (!serialize_transform(p, &frame->transforms[index]))
-			net_error();
-		index = frame->active.next(index);
+		return false;
 	}
-#if DEBUG_TRANSFORMS
-	vi_debug("Wrote %d transforms", s32(frame->count));
-#endif
-	return true;
-}
 
-b8 transform_frame_read(StreamRead* p, TransformFrame* frame, const TransformFrame* base)
+	void bits(u32 v, s32 bits)
+	{
+		value |= u64(v) << bit_count;
+		bit_count += bits;
+	}
+};
+
+struct QuantizeRead
 {
-	using Stream = StreamRead;
-	frame->timestamp = Game::real_time.total;
-	serialize_int(p, SequenceID, frame->sequence_id, 0, SEQUENCE_COUNT - 1);
-	serialize_int(p, u16, frame->count, 0, MAX_ENTITIES - 1);
-	for (s32 i = 0; i < frame->count; i++)
+	enum { IsWriting = 0 };
+	enum { IsReading = 1 };
+
+	u64 value;
+
+	QuantizeRead(u64 v) : value(v) {}
+
+	b8 would_overflow(s32) const
 	{
-		s32 index;
-		serialize_int(p, s32, index, 0, MAX_ENTITIES - 1);
-		frame->active.set(index, true);
-		if (!serialize_transform(p, &frame->transforms[index]))
-			net_error();
+		return false;
 	}
-#if DEBUG_TRANSFORMS
-	vi_debug("Read %d transforms", s32(frame->count));
-#endif
-	return true;
-}
 
-b8 transform_filter(const Transform* t)
+	void bits(u32& v, s32 bits)
+	{
+		v = u32(value & ((u64(1) << bits) - 1));
+		value >>= bits;
+	}
+};
+
+void transform_state_quantize(TransformState* state, const Vec3& pos, const Quat& rot)
 {
-	return t->has<Awk>()
-		|| t->has<EnergyPickup>()
-		|| t->has<Projectile>()
-		|| t->has<Rocket>()
-		|| t->has<Walker>()
-		|| t->has<Sensor>();
+	{
+		QuantizeWrite q;
+		Vec3 p = pos;
+		serialize_position(&q, &p);
+		vi_assert(q.bit_count == TRANSFORM_POS_BITS);
+		state->pos = q.value;
+	}
+	{
+		QuantizeWrite q;
+		Quat r = rot;
+		serialize_quat(&q, &r);
+		vi_assert(q.bit_count == TRANSFORM_ROT_BITS);
+		state->rot = u32(q.value);
+	}
 }
 
-void transform_frame_build(TransformFrame* frame)
+void transform_state_dequantize(const TransformState& state, Vec3* pos, Quat* rot)
 {
-	frame->sequence_id = local_sequence_id;
-	frame->active = Transform::list.mask;
-	frame->count = Transform::list.count();
-	for (auto i = Transform::list.iterator(); !i.is_last(); i.next())
 	{
-		if (transform_filter(i.item()))
-		{
-			TransformState* transform = &frame->transforms[i.index];
-			transform->pos = i.item()->pos;
-			transform->rot = i.item()->rot;
-			transform->parent = i.item()->parent.ref();
-		}
-		else
-		{
-			frame->active.set(i.index, false);
-			frame->count--;
-		}
+		QuantizeRead q(state.pos);
+		serialize_position(&q, pos);
+	}
+	{
+		QuantizeRead q(state.rot);
+		serialize_quat(&q, rot);
 	}
 }
 
-// get the absolute pos and rot of the given transform
-void transform_absolute(const TransformFrame& frame, s32 index, Vec3* abs_pos, Quat* abs_rot)
+// fields which changed relative to the base frame
+enum TransformField
 {
-	const TransformState* transform = &frame.transforms[index];
-	*abs_rot = Quat::identity;
-	*abs_pos = Vec3::zero;
-	while (transform)
-	{ 
-		*abs_rot = transform->rot * *abs_rot;
-		*abs_pos = (transform->rot * *abs_pos) + transform->pos;
-		if (transform->parent.id == IDNull)
-			break;
-		else
-			transform = &frame.transforms[transform->parent.id];
-	}
+	TransformFieldPos = 1 << 0,
+	TransformFieldRot = 1 << 1,
+	TransformFieldParent = 1 << 2,
+	TransformFieldAll = TransformFieldPos | TransformFieldRot | TransformFieldParent,
+};
+
+// transforms are stored quantized, so equal bits means the client can't tell the difference
+s32 transform_delta_fields(const TransformState& transform, const TransformState& base)
+{
+	s32 fields = 0;
+	if (transform.pos != base.pos)
+		fields |= TransformFieldPos;
+	if (transform.rot != base.rot)
+		fields |= TransformFieldRot;
+	if (transform.parent.id != base.parent.id || (transform.parent.id != IDNull && transform.parent.revision != base.parent.revision))
+		fields |= TransformFieldParent;
+	return fields;
 }
 
-// convert the given pos and rot to the local coordinate system of the given transform
-void transform_absolute_to_relative(const TransformFrame& frame, s32 index, Vec3* pos, Quat* rot)
+typedef u16 CommandID;
+
+// one frame of input for a player's awk.
+// the client simulates it immediately, and the server simulates it when it arrives.
+struct AwkCommand
 {
-	Quat abs_rot;
-	Vec3 abs_pos;
-	transform_absolute(frame, index, &abs_pos, &abs_rot);
+	Vec3 movement;
+	r32 dt;
+	CommandID id;
+};
 
-	Quat abs_rot_inverse = abs_rot.inverse();
-	*rot = abs_rot_inverse * *rot;
-	*pos = abs_rot_inverse * (*pos - abs_pos);
+// true if c1 > c2
+b8 command_more_recent(CommandID c1, CommandID c2)
+{
+	return s16(u16(c1 - c2)) > 0;
 }
 
-void transform_frame_interpolate(const TransformFrame& a, const TransformFrame& b, TransformFrame* result, r32 timestamp)
+template<typename Stream> b8 serialize_command(Stream* p, AwkCommand* c)
 {
-	result->timestamp = timestamp;
-	vi_assert(timestamp >= a.timestamp);
-	r32 blend = vi_min((timestamp - a.timestamp) / (b.timestamp - a.timestamp), 1.0f);
-	result->sequence_id = b.sequence_id;
-	result->count = b.count;
-	result->active = b.active;
-	s32 index = s32(b.active.start);
-	for (s32 i = 0; i < b.count; i++)
+	serialize_r32_range(p, c->movement.x, -1.0f, 1.0f, 16);
+	serialize_r32_range(p, c->movement.y, -1.0f, 1.0f, 16);
+	serialize_r32_range(p, c->movement.z, -1.0f, 1.0f, 16);
+	serialize_r32_range(p, c->dt, 0.0f, COMMAND_DT_MAX, 12);
+	return true;
+}
+
+// both sides have to simulate exactly the same command, so the client uses the quantized version too
+void command_quantize(AwkCommand* c)
+{
+	QuantizeWrite w;
+	serialize_command(&w, c);
+	QuantizeRead r(w.value);
+	serialize_command(&r, c);
+}
+
+void command_simulate(Awk* awk, const AwkCommand& c, const Update& u)
+{
+	Update command_update = u;
+	command_update.time.delta = c.dt;
+	awk->crawl(c.movement, command_update);
+}
+
+struct TransformDelta
+{
+	ID index;
+	u8 fields;
+};
+
+// scratch space for writing and reading transform frames; too big for the stack with a large MAX_ENTITIES.
+// only used on the game thread.
+struct TransformScratch
+{
+	StaticArray<TransformDelta, MAX_ENTITIES> changes;
+	u64 run[MAX_ENTITIES];
+	Bitmask<MAX_ENTITIES> base_active;
+	Bitmask<MAX_ENTITIES> relevant;
+};
+
+TransformScratch transform_scratch;
+
+void transform_snapshot_expand(const TransformSnapshot& snapshot, TransformFrame* frame)
+{
+	frame->timestamp = snapshot.timestamp;
+	frame->sequence_id = snapshot.sequence_id;
+	frame->active.clear();
+	frame->count = u16(snapshot.indices.length);
+	for (s32 i = 0; i < snapshot.indices.length; i++)
 	{
-		TransformState* transform = &result->transforms[index];
-		transform->parent = a.transforms[index].parent;
-		transform_absolute(a, index, &transform->pos, &transform->rot);
+		ID index = snapshot.indices[i];
+		frame->active.set(index, true);
+		frame->transforms[index] = snapshot.transforms[i];
+	}
+}
 
-		Vec3 next_abs_pos;
-		Quat next_abs_rot;
-		transform_absolute(b, index, &next_abs_pos, &next_abs_rot);
+void transform_snapshot_pack(const TransformFrame& frame, TransformSnapshot* snapshot)
+{
+	snapshot->timestamp = frame.timestamp;
+	snapshot->sequence_id = frame.sequence_id;
+	snapshot->valid = true;
+	snapshot->indices.resize(frame.count);
+	snapshot->transforms.resize(frame.count);
+	s32 i = 0;
+	for (s32 index = frame.active.start; index < frame.active.end; index = frame.active.next(index))
+	{
+		if (frame.active.get(index))
+		{
+			snapshot->indices[i] = ID(index);
+			snapshot->transforms[i] = frame.transforms[index];
+			i++;
+		}
+	}
+	vi_assert(i == frame.count);
+}
+
+// only transforms which changed relative to the base frame go on the wire.
+// the client rebuilds the frame by copying its own version of the base and applying the changes.
+// transforms not in the relevant mask are left alone; the client keeps whatever it had for them.
+// on return, relevant contains only the transforms we actually wrote.
+// view receives the frame exactly as the client will reconstruct it, so it can serve as a future base.
+b8 transform_frame_write(StreamWrite* p, const TransformFrame* frame, const TransformSnapshot* base, Bitmask<MAX_ENTITIES>* relevant, TransformFrame* view)
+{
+	using Stream = StreamWrite;
+	SequenceID sequence_id = frame->sequence_id;
+	serialize_int(p, SequenceID, sequence_id, 0, SEQUENCE_COUNT - 1);
+	b8 has_base = base != nullptr;
+	serialize_bool(p, has_base);
+	if (has_base)
+	{
+		SequenceID base_sequence_id = base->sequence_id;
+		serialize_int(p, SequenceID, base_sequence_id, 0, SEQUENCE_COUNT - 1);
+	}
 
-		transform->pos = Vec3::lerp(blend, transform->pos, next_abs_pos);
-		transform->rot = Quat::slerp(blend, transform->rot, next_abs_rot);
-		if (transform->parent.id != IDNull)
-			transform_absolute_to_relative(a, transform->parent.id, &transform->pos, &transform->rot);
-		index = b.active.next(index);
+	// start from the client's version of the base.
+	// each transform is only touched once below, so until then, view still matches the base.
+	if (has_base)
+		transform_snapshot_expand(*base, view);
+	else
+	{
+		view->active.clear();
+		view->count = 0;
 	}
+	Bitmask<MAX_ENTITIES>& base_active = transform_scratch.base_active;
+	base_active = view->active;
+	view->sequence_id = frame->sequence_id;
+	view->timestamp = frame->timestamp;
+
+	// changed and new transforms
+	{
+		StaticArray<TransformDelta, MAX_ENTITIES>& changes = transform_scratch.changes;
+		changes.length = 0;
+		for (s32 index = frame->active.start; index < frame->active.end; index = frame->active.next(index))
+		{
+			if (!frame->active.get(index) || !relevant->get(index))
+				continue;
+			s32 fields;
+			if (base_active.get(index))
+				fields = transform_delta_fields(frame->transforms[index], view->transforms[index]);
+			else
+				fields = TransformFieldAll;
+			if (fields)
+				changes.add({ ID(index), u8(fields) });
+			else
+				relevant->set(index, false);
+		}
+
+		s32 count = changes.length;
+		serialize_int(p, s32, count, 0, MAX_ENTITIES);
+
+		// each field goes out as one run across all the changes, so the fixed-width ones can be packed in bulk
+		u64* run = transform_scratch.run;
+		s32 run_length;
+
+		for (s32 i = 0; i < count; i++)
+			run[i] = changes[i].index;
+		serialize_bulk(p, run, count, bits_required(0, MAX_ENTITIES - 1));
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (base_active.get(changes[i].index))
+				run[run_length++] = changes[i].fields - 1;
+		}
+		serialize_bulk(p, run, run_length, bits_required(1, TransformFieldAll));
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldPos)
+				run[run_length++] = frame->transforms[changes[i].index].pos;
+		}
+		serialize_bulk(p, run, run_length, TRANSFORM_POS_BITS);
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldRot)
+				run[run_length++] = frame->transforms[changes[i].index].rot;
+		}
+		serialize_bulk(p, run, run_length, TRANSFORM_ROT_BITS);
+
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldParent)
+				serialize_ref(p, frame->transforms[changes[i].index].parent);
+		}
+
+		for (s32 i = 0; i < count; i++)
+		{
+			const TransformDelta& change = changes[i];
+			const TransformState& transform = frame->transforms[change.index];
+
+			// the client keeps the base value of any field we didn't send
+			TransformState* v = &view->transforms[change.index];
+			if (change.fields & TransformFieldPos)
+				v->pos = transform.pos;
+			if (change.fields & TransformFieldRot)
+				v->rot = transform.rot;
+			if (change.fields & TransformFieldParent)
+				v->parent = transform.parent;
+			if (!view->active.get(change.index))
+			{
+				view->active.set(change.index, true);
+				view->count++;
+			}
+		}
+#if DEBUG_TRANSFORMS
+		vi_debug("Wrote %d/%d transforms", count, s32(frame->count));
+#endif
+	}
+
+	// removed transforms
+	// these go out regardless of relevance, otherwise the client would hang on to dead transforms
+	if (has_base)
+	{
+		s32 count = 0;
+		for (s32 i = 0; i < base->indices.length; i++)
+		{
+			if (!frame->active.get(base->indices[i]))
+				count++;
+		}
+		serialize_int(p, s32, count, 0, MAX_ENTITIES);
+		for (s32 i = 0; i < base->indices.length; i++)
+		{
+			s32 index = base->indices[i];
+			if (!frame->active.get(index))
+			{
+				serialize_int(p, s32, index, 0, MAX_ENTITIES - 1);
+				view->active.set(index, false);
+				view->count--;
+			}
+		}
+	}
+
+	return true;
+}
+
+const TransformSnapshot* transform_history_most_recent(const TransformHistory& history)
+{
+	return history.empty ? nullptr : &history.snapshots[history.most_recent];
+}
+
+const TransformSnapshot* transform_history_by_sequence(const TransformHistory& history, SequenceID sequence_id)
+{
+	const TransformSnapshot* snapshot = &history.snapshots[sequence_id];
+	return snapshot->valid ? snapshot : nullptr;
 }
 
-TransformFrame* transform_frame_add(TransformHistory* history)
+// sequence IDs must only move forward
+TransformSnapshot* transform_history_add(TransformHistory* history, SequenceID sequence_id)
 {
-	TransformFrame* frame;
-	if (history->frames.length < history->frames.capacity())
+	if (history->empty)
 	{
-		frame = history->frames.add();
-		history->current_index = history->frames.length - 1;
+		for (s32 i = 0; i < SEQUENCE_COUNT; i++)
+			history->snapshots[i].valid = false;
+		history->empty = false;
 	}
 	else
 	{
-		history->current_index = (history->current_index + 1) % history->frames.capacity();
-		frame = &history->frames[history->current_index];
+		// anything we skipped over is from the last time around the sequence ring
+		vi_assert(sequence_id == history->most_recent || sequence_more_recent(sequence_id, history->most_recent));
+		for (SequenceID i = sequence_advance(history->most_recent, 1); i != sequence_id; i = sequence_advance(i, 1))
+			history->snapshots[i].valid = false;
 	}
-	new (frame) TransformFrame();
-	frame->timestamp = Game::real_time.total;
-	return frame;
+	history->most_recent = sequence_id;
+	return &history->snapshots[sequence_id];
+}
+
+#define TRANSFORM_HISTORY_SEARCH (SEQUENCE_COUNT / 2) // how far back the timestamp lookup will look
+
+const TransformSnapshot* transform_history_back(const TransformHistory& history, s32 distance)
+{
+	return &history.snapshots[sequence_advance(history.most_recent, -distance)];
 }
 
-const TransformFrame* transform_frame_by_sequence(const TransformHistory& history, SequenceID sequence_id)
+// most recent snapshot older than the given timestamp.
+// snapshots arrive roughly once per tick, so we can guess where it is and walk the rest of the way.
+const TransformSnapshot* transform_history_by_timestamp(const TransformHistory& history, r32 timestamp)
 {
-	if (history.frames.length > 0)
+	const TransformSnapshot* most_recent = transform_history_most_recent(history);
+	if (!most_recent)
+		return nullptr;
+
+	s32 guess = vi_max(0, vi_min(TRANSFORM_HISTORY_SEARCH - 1, s32((most_recent->timestamp - timestamp) / TICK_RATE)));
+
+	// walk back from the guess to the first snapshot that is old enough
+	const TransformSnapshot* result = nullptr;
+	s32 distance;
+	for (distance = guess; distance < TRANSFORM_HISTORY_SEARCH; distance++)
 	{
-		s32 index = history.current_index;
-		for (s32 i = 0; i < 64; i++)
+		const TransformSnapshot* snapshot = transform_history_back(history, distance);
+		if (snapshot->valid && snapshot->timestamp < timestamp)
 		{
-			// loop backward through most recent frames
-			index = index > 0 ? index - 1 : history.frames.length - 1;
-			if (index == history.current_index) // we looped all the way around
-				break;
+			result = snapshot;
+			break;
+		}
+	}
+	if (!result)
+		return nullptr;
 
-			const TransformFrame* frame = &history.frames[index];
-			if (frame->sequence_id == sequence_id)
-				return frame;
+	// in case we guessed too far back, walk forward while newer snapshots are still old enough
+	for (distance = distance - 1; distance >= 0; distance--)
+	{
+		const TransformSnapshot* snapshot = transform_history_back(history, distance);
+		if (snapshot->valid)
+		{
+			if (snapshot->timestamp >= timestamp)
+				break;
+			result = snapshot;
 		}
 	}
+
+	return result;
+}
+
+const TransformSnapshot* transform_history_previous(const TransformHistory& history, const TransformSnapshot& snapshot)
+{
+	SequenceID sequence = snapshot.sequence_id;
+	for (s32 i = 1; i < TRANSFORM_HISTORY_SEARCH; i++)
+	{
+		sequence = sequence_advance(sequence, -1);
+		if (history.snapshots[sequence].valid)
+			return &history.snapshots[sequence];
+	}
 	return nullptr;
 }
 
-const TransformFrame* transform_frame_by_timestamp(const TransformHistory& history, r32 timestamp)
+const TransformSnapshot* transform_history_next(const TransformHistory& history, const TransformSnapshot& snapshot)
 {
-	if (history.frames.length > 0)
+	SequenceID sequence = snapshot.sequence_id;
+	while (sequence != history.most_recent)
 	{
-		s32 index = history.current_index;
-		for (s32 i = 0; i < 64; i++)
+		sequence = sequence_advance(sequence, 1);
+		if (history.snapshots[sequence].valid)
+			return &history.snapshots[sequence];
+	}
+	return nullptr;
+}
+
+b8 transform_frame_read(StreamRead* p, TransformFrame* frame, const TransformHistory& history)
+{
+	using Stream = StreamRead;
+	frame->timestamp = Game::real_time.total;
+	serialize_int(p, SequenceID, frame->sequence_id, 0, SEQUENCE_COUNT - 1);
+	b8 has_base;
+	serialize_bool(p, has_base);
+	const TransformSnapshot* base = nullptr;
+	if (has_base)
+	{
+		SequenceID base_sequence_id;
+		serialize_int(p, SequenceID, base_sequence_id, 0, SEQUENCE_COUNT - 1);
+		base = transform_history_by_sequence(history, base_sequence_id);
+		if (!base)
 		{
-			const TransformFrame* frame = &history.frames[index];
+			// we can't reconstruct this frame. our transform ack still names the last frame we kept,
+			// so the server will go back to that base, or send a full frame if it no longer has it.
+			vi_debug("Discarding transform frame %d; missing base frame %d", s32(frame->sequence_id), s32(base_sequence_id));
+			return false;
+		}
+		SequenceID sequence_id = frame->sequence_id;
+		r32 timestamp = frame->timestamp;
+		transform_snapshot_expand(*base, frame);
+		frame->sequence_id = sequence_id;
+		frame->timestamp = timestamp;
+	}
+	else
+	{
+		frame->active.clear();
+		frame->count = 0;
+	}
+	Bitmask<MAX_ENTITIES>& base_active = transform_scratch.base_active;
+	base_active = frame->active;
 
-			if (frame->timestamp < timestamp)
-				return &history.frames[index];
+	s32 count;
+	serialize_int(p, s32, count, 0, MAX_ENTITIES);
 
-			// loop backward through most recent frames
-			index = index > 0 ? index - 1 : history.frames.length - 1;
-			if (index == history.current_index) // we looped all the way around
-				break;
+	// see transform_frame_write for the layout
+	{
+		StaticArray<TransformDelta, MAX_ENTITIES>& changes = transform_scratch.changes;
+		changes.length = 0;
+		u64* run = transform_scratch.run;
+		s32 run_length;
+
+		serialize_bulk(p, run, count, bits_required(0, MAX_ENTITIES - 1));
+		for (s32 i = 0; i < count; i++)
+		{
+			if (run[i] >= MAX_ENTITIES)
+				net_error();
+			changes.add({ ID(run[i]), u8(TransformFieldAll) });
+		}
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (base_active.get(changes[i].index))
+				run_length++;
+		}
+		serialize_bulk(p, run, run_length, bits_required(1, TransformFieldAll));
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			TransformDelta* change = &changes[i];
+			if (base_active.get(change->index))
+			{
+				u64 fields = run[run_length++] + 1;
+				if (fields > TransformFieldAll)
+					net_error();
+				change->fields = u8(fields);
+			}
+			else if (!frame->active.get(change->index))
+			{
+				frame->active.set(change->index, true);
+				frame->count++;
+			}
+		}
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldPos)
+				run_length++;
+		}
+		serialize_bulk(p, run, run_length, TRANSFORM_POS_BITS);
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldPos)
+				frame->transforms[changes[i].index].pos = run[run_length++];
+		}
+
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldRot)
+				run_length++;
+		}
+		serialize_bulk(p, run, run_length, TRANSFORM_ROT_BITS);
+		run_length = 0;
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldRot)
+				frame->transforms[changes[i].index].rot = u32(run[run_length++]);
+		}
+
+		for (s32 i = 0; i < count; i++)
+		{
+			if (changes[i].fields & TransformFieldParent)
+				serialize_ref(p, frame->transforms[changes[i].index].parent);
 		}
 	}
-	return nullptr;
+
+	if (base)
+	{
+		s32 removed;
+		serialize_int(p, s32, removed, 0, MAX_ENTITIES);
+		for (s32 i = 0; i < removed; i++)
+		{
+			s32 index;
+			serialize_int(p, s32, index, 0, MAX_ENTITIES - 1);
+			if (frame->active.get(index))
+			{
+				frame->active.set(index, false);
+				frame->count--;
+			}
+		}
+	}
+
+#if DEBUG_TRANSFORMS
+	vi_debug("Read %d/%d transforms", count, s32(frame->count));
+#endif
+	return true;
 }
 
-const TransformFrame* transform_frame_next(const TransformHistory& history, const TransformFrame& frame)
+b8 transform_filter(const Transform* t)
+{
+	return t->has<Awk>()
+		|| t->has<EnergyPickup>()
+		|| t->has<Projectile>()
+		|| t->has<Rocket>()
+		|| t->has<Walker>()
+		|| t->has<Sensor>();
+}
+
+void transform_frame_build(TransformFrame* frame)
 {
-	if (history.frames.length > 1)
+	frame->sequence_id = local_sequence_id;
+	frame->timestamp = Game::real_time.total;
+	frame->active = Transform::list.mask;
+	frame->count = Transform::list.count();
+	for (auto i = Transform::list.iterator(); !i.is_last(); i.next())
 	{
-		s32 index = &frame - history.frames.data;
-		index = index < history.frames.length - 1 ? index + 1 : 0;
-		const TransformFrame& frame_next = history.frames[index];
-		if (sequence_more_recent(frame_next.sequence_id, frame.sequence_id))
-			return &frame_next;
+		if (transform_filter(i.item()))
+		{
+			TransformState* transform = &frame->transforms[i.index];
+			transform_state_quantize(transform, i.item()->pos, i.item()->rot);
+			transform->parent = i.item()->parent.ref();
+		}
+		else
+		{
+			frame->active.set(i.index, false);
+			frame->count--;
+		}
+	}
+}
+
+// get the absolute pos and rot of the given transform
+void transform_absolute(const TransformFrame& frame, s32 index, Vec3* abs_pos, Quat* abs_rot)
+{
+	const TransformState* transform = &frame.transforms[index];
+	*abs_rot = Quat::identity;
+	*abs_pos = Vec3::zero;
+	while (transform)
+	{ 
+		Vec3 pos;
+		Quat rot;
+		transform_state_dequantize(*transform, &pos, &rot);
+		*abs_rot = rot * *abs_rot;
+		*abs_pos = (rot * *abs_pos) + pos;
+		if (transform->parent.id == IDNull)
+			break;
+		else
+			transform = &frame.transforms[transform->parent.id];
+	}
+}
+
+// convert the given pos and rot to the local coordinate system of the given transform
+void transform_absolute_to_relative(const TransformFrame& frame, s32 index, Vec3* pos, Quat* rot)
+{
+	Quat abs_rot;
+	Vec3 abs_pos;
+	transform_absolute(frame, index, &abs_pos, &abs_rot);
+
+	Quat abs_rot_inverse = abs_rot.inverse();
+	*rot = abs_rot_inverse * *rot;
+	*pos = abs_rot_inverse * (*pos - abs_pos);
+}
+
+// apply the given frame to the world, blending toward the next frame if we have it.
+// blend can go past 1 to extrapolate positions; rotations stop at b.
+// the skipped transform is left alone because we're predicting it locally.
+void transform_frame_apply(const TransformFrame& a, const TransformFrame* b, r32 blend, ID skip)
+{
+	if (!b)
+	{
+		for (s32 index = a.active.start; index < a.active.end; index = a.active.next(index))
+		{
+			if (!a.active.get(index) || index == skip)
+				continue;
+			Transform* t = &Transform::list[index];
+			const TransformState& s = a.transforms[index];
+			transform_state_dequantize(s, &t->pos, &t->rot);
+			t->parent = s.parent;
+		}
+		return;
+	}
+
+	for (s32 index = b->active.start; index < b->active.end; index = b->active.next(index))
+	{
+		if (!b->active.get(index) || index == skip)
+			continue;
+
+		Transform* t = &Transform::list[index];
+		if (!a.active.get(index))
+		{
+			// new transform; nothing to blend from
+			const TransformState& s = b->transforms[index];
+			transform_state_dequantize(s, &t->pos, &t->rot);
+			t->parent = s.parent;
+			continue;
+		}
+
+		Vec3 pos;
+		Quat rot;
+		transform_absolute(a, index, &pos, &rot);
+
+		Vec3 next_abs_pos;
+		Quat next_abs_rot;
+		transform_absolute(*b, index, &next_abs_pos, &next_abs_rot);
+
+		pos = Vec3::lerp(blend, pos, next_abs_pos);
+		rot = Quat::slerp(vi_min(blend, 1.0f), rot, next_abs_rot);
+		Ref<Transform> parent = a.transforms[index].parent;
+		if (parent.id != IDNull)
+			transform_absolute_to_relative(a, parent.id, &pos, &rot);
+		t->pos = pos;
+		t->rot = rot;
+		t->parent = parent;
 	}
-	return nullptr;
 }
 
 #if SERVER
@@ -1198,7 +2171,18 @@ const TransformFrame* transform_frame_next(const TransformHistory& history, cons
 namespace Server
 {
 
-struct LocalPlayer;
+#define RELEVANCE_CELL_SIZE 16.0f // size of the area-of-interest grid cells
+#define RELEVANCE_NEAR_CELLS 1 // transforms within this many cells of the viewer update every tick
+#define RELEVANCE_MIN_RATE (1.0f / 30.0f) // distant transforms still update at least this often
+#define CLIENT_VIEW_HISTORY 32 // must divide SEQUENCE_COUNT
+
+// what a client has reconstructed for each transform frame we sent it recently,
+// plus how overdue each transform is for an update
+struct ClientView
+{
+	TransformSnapshot frames[CLIENT_VIEW_HISTORY]; // indexed by sequence ID
+	r32 priority[MAX_ENTITIES];
+};
 
 struct Client
 {
@@ -1209,10 +2193,21 @@ struct Client
 	MessageHistory msgs_in_history; // messages we've received from the client
 	SequenceHistory recently_resent; // sequences we resent to the client recently
 	SequenceID processed_sequence_id; // most recent sequence ID we've processed from the client
-	Ref<LocalPlayer> player;
+	CommandID processed_command_id; // most recent input command we've simulated for the client
+	SequenceID transform_ack; // most recent transform frame the client managed to reconstruct
+	b8 transform_acked;
+	ClientView view;
+	Ref<PlayerManager> player; // until the client's player has spawned, everything is relevant
 	b8 connected;
 };
 
+struct RelevanceCell
+{
+	s8 x;
+	s8 y;
+	s8 z;
+};
+
 enum Mode
 {
 	Waiting,
@@ -1222,9 +2217,13 @@ enum Mode
 
 Array<Client> clients;
 r32 tick_timer;
+u16 port = NET_SERVER_PORT;
+AssetID level = Asset::Level::Ponos;
 Mode mode;
-s32 expected_clients = 1;
-TransformHistory transform_history;
+s32 expected_clients = 1; // the match starts once this many clients are connected
+TransformFrame transform_frame; // rebuilt every tick
+TransformFrame transform_view; // scratch space for reconstructing what each client sees
+RelevanceCell relevance_grid[MAX_ENTITIES]; // grid cell of each transform in the current frame
 
 s32 connected_clients()
 {
@@ -1239,14 +2238,14 @@ s32 connected_clients()
 
 b8 init()
 {
-	if (Sock::udp_open(&sock, 3494, true))
+	if (!replay_path && Sock::udp_open(&sock, port, true))
 	{
 		printf("%s\n", Sock::get_error());
 		return false;
 	}
 
 	Game::session.multiplayer = true;
-	Game::load_level(Update(), Asset::Level::Ponos, Game::Mode::Pvp, true);
+	Game::load_level(Update(), level, Game::Mode::Pvp, true);
 
 	return true;
 }
@@ -1272,7 +2271,202 @@ b8 build_packet_keepalive(StreamWrite* p)
 	return true;
 }
 
-b8 build_packet_update(StreamWrite* p, Client* client)
+RelevanceCell relevance_cell(const Vec3& pos)
+{
+	RelevanceCell cell;
+	cell.x = s8(floorf(pos.x / RELEVANCE_CELL_SIZE));
+	cell.y = s8(floorf(pos.y / RELEVANCE_CELL_SIZE));
+	cell.z = s8(floorf(pos.z / RELEVANCE_CELL_SIZE));
+	return cell;
+}
+
+s32 relevance_cell_distance(const RelevanceCell& a, const RelevanceCell& b)
+{
+	return vi_max(vi_max(abs(s32(a.x) - s32(b.x)), abs(s32(a.y) - s32(b.y))), abs(s32(a.z) - s32(b.z)));
+}
+
+void relevance_grid_build(const TransformFrame* frame)
+{
+	for (s32 index = frame->active.start; index < frame->active.end; index = frame->active.next(index))
+	{
+		if (frame->active.get(index))
+			relevance_grid[index] = relevance_cell(Transform::list[index].absolute_pos());
+	}
+}
+
+// decide which transforms the client gets this tick.
+// everything near the client's player, plus any player their team can see, updates every tick.
+// everything else accumulates priority based on distance and goes out once it has built up enough.
+// only transforms are filtered; messages share one history across all clients, so everyone gets every event.
+void relevance_build(Client* client, const TransformFrame* frame, Bitmask<MAX_ENTITIES>* relevant)
+{
+	PlayerManager* manager = client->player.ref();
+	Entity* viewer = manager ? manager->entity.ref() : nullptr;
+	if (!viewer)
+	{
+		*relevant = frame->active;
+		return;
+	}
+
+	RelevanceCell viewer_cell = relevance_cell(viewer->get<Transform>()->absolute_pos());
+	const Team* viewer_team = manager->team.ref();
+	PlayerCommon* viewer_common = viewer->get<PlayerCommon>();
+
+	relevant->clear();
+	r32* priority = client->view.priority;
+	for (s32 index = frame->active.start; index < frame->active.end; index = frame->active.next(index))
+	{
+		if (!frame->active.get(index))
+			continue;
+
+		r32 rate;
+		s32 distance = relevance_cell_distance(viewer_cell, relevance_grid[index]);
+		if (distance <= RELEVANCE_NEAR_CELLS)
+			rate = 1.0f;
+		else
+			rate = vi_max(r32(RELEVANCE_NEAR_CELLS + 1) / r32(distance), RELEVANCE_MIN_RATE);
+
+		Entity* entity = Transform::list[index].entity();
+		if (entity == viewer)
+			rate = 1.0f;
+		else if (entity->has<PlayerCommon>())
+		{
+			PlayerCommon* other = entity->get<PlayerCommon>();
+			if (entity->get<AIAgent>()->team == viewer_team->team()
+				|| viewer_team->player_tracks[other->manager.id].tracking
+				|| PlayerCommon::visibility.get(PlayerCommon::visibility_hash(viewer_common, other)))
+				rate = 1.0f;
+		}
+
+		priority[index] = vi_min(priority[index] + rate, 1.0f);
+		if (priority[index] >= 1.0f)
+			relevant->set(index, true);
+	}
+
+	// the client can't place a transform without its parents
+	for (s32 index = relevant->start; index < relevant->end; index = relevant->next(index))
+	{
+		if (!relevant->get(index))
+			continue;
+		ID parent = frame->transforms[index].parent.id;
+		while (parent != IDNull && frame->active.get(parent) && !relevant->get(parent))
+		{
+			relevant->set(parent, true);
+			parent = frame->transforms[parent].parent.id;
+		}
+	}
+}
+
+// spawn an awk for a client's player
+void player_spawn(PlayerManager* manager)
+{
+	Vec3 pos;
+	Quat rot;
+	manager->team.ref()->player_spawn.ref()->absolute(&pos, &rot);
+	pos += Quat::euler(0, (manager->id() * PI * 0.5f), 0) * Vec3(0, 0, CONTROL_POINT_RADIUS * 0.5f); // spawn it around the edges
+
+	Entity* e = World::create<AwkEntity>(manager->team.ref()->team());
+	e->get<Transform>()->absolute(pos, rot);
+	e->add<PlayerCommon>(manager);
+
+	manager->entity = e;
+
+	Net::finalize(e);
+}
+
+// clients don't have a controller object on the server, so the spawn link goes straight to the manager
+struct PlayerSpawnLinkEntry : public LinkEntry
+{
+	PlayerSpawnLinkEntry(PlayerManager* manager)
+		: LinkEntry(manager->id(), manager->revision)
+	{
+	}
+
+	virtual void fire() const
+	{
+		PlayerManager* manager = &PlayerManager::list[data.id];
+		if (manager->revision != data.revision)
+			return;
+
+		// only spawn if the client is still around
+		for (s32 i = 0; i < clients.length; i++)
+		{
+			if (clients[i].player.ref() == manager)
+			{
+				player_spawn(manager);
+				break;
+			}
+		}
+	}
+};
+
+// every client gets a player of its own; teams are filled round-robin
+void player_add(Client* client)
+{
+	PlayerManager* manager = PlayerManager::list.add();
+	new (manager) PlayerManager(&Team::list[(connected_clients() - 1) % Team::list.length]);
+	new (manager->spawn.entries.add()) PlayerSpawnLinkEntry(manager);
+	client->player = manager;
+}
+
+// drop a departing client's player along with its awk, so the slot can be reused
+void player_remove(Client* client)
+{
+	PlayerManager* manager = client->player.ref();
+	if (!manager)
+		return;
+	if (Entity* e = manager->entity.ref())
+		World::remove(e);
+	manager->revision++;
+	PlayerManager::list.remove(manager->id());
+	client->player = nullptr;
+}
+
+// every client needs a PlayerManager, and level-loaded managers take slots too.
+// clients which have connected but not yet acked the init packet have a slot reserved.
+b8 player_slot_available()
+{
+	s32 pending = clients.length - connected_clients();
+	return PlayerManager::list.count() + pending < MAX_PLAYERS;
+}
+
+Awk* client_awk(const Client* client)
+{
+	PlayerManager* manager = client->player.ref();
+	Entity* entity = manager ? manager->entity.ref() : nullptr;
+	return entity ? entity->get<Awk>() : nullptr;
+}
+
+// the client sends its most recent commands with every packet; simulate the ones we haven't seen yet.
+// commands that got lost entirely are skipped; the client will snap to wherever we end up.
+// without an awk to drive, nothing is simulated, so nothing is acked either.
+b8 commands_read(const Update& u, StreamRead* p, Client* client)
+{
+	using Stream = StreamRead;
+	s32 count;
+	serialize_int(p, s32, count, 0, COMMAND_REDUNDANCY);
+	if (count > 0)
+	{
+		CommandID newest;
+		serialize_u16(p, newest);
+		Awk* awk = client_awk(client);
+		for (s32 i = 0; i < count; i++)
+		{
+			AwkCommand c;
+			if (!serialize_command(p, &c))
+				net_error();
+			c.id = CommandID(newest - (count - 1 - i));
+			if (awk && command_more_recent(c.id, client->processed_command_id))
+			{
+				command_simulate(awk, c, u);
+				client->processed_command_id = c.id;
+			}
+		}
+	}
+	return true;
+}
+
+b8 build_packet_update(StreamWrite* p, Client* client, const TransformFrame* frame)
 {
 	packet_init(p);
 	using Stream = StreamWrite;
@@ -1282,11 +2476,31 @@ b8 build_packet_update(StreamWrite* p, Client* client)
 	serialize_int(p, SequenceID, ack.sequence_id, 0, SEQUENCE_COUNT - 1);
 	serialize_u32(p, ack.previous_sequences);
 	msgs_write(p, msgs_out_history, client->ack, &client->recently_resent, client->rtt);
-	serialize_int(p, SequenceID, client->ack.sequence_id, 0, SEQUENCE_COUNT - 1);
-	const TransformFrame* base = transform_frame_by_sequence(transform_history, client->ack.sequence_id);
-	TransformFrame* frame = transform_frame_add(&transform_history);
-	transform_frame_build(frame);
-	transform_frame_write(p, frame, base);
+	serialize_u16(p, client->processed_command_id); // transforms in this packet reflect input up to here
+
+	// sequence IDs only advance once we're active, so until then, always send full frames.
+	// the client can receive a packet and still fail to reconstruct its transform frame,
+	// so it acks transform frames separately from messages, and we only delta against frames it kept.
+	// deltas are against the client's version of that frame, which lags the real one for low priority transforms.
+	TransformSnapshot* view = &client->view.frames[frame->sequence_id % CLIENT_VIEW_HISTORY];
+	const TransformSnapshot* base = nullptr;
+	if (mode == Mode::Active && client->transform_acked)
+	{
+		base = &client->view.frames[client->transform_ack % CLIENT_VIEW_HISTORY];
+		if (base == view || !base->valid || base->sequence_id != client->transform_ack)
+			base = nullptr;
+	}
+
+	Bitmask<MAX_ENTITIES>& relevant = transform_scratch.relevant;
+	relevance_build(client, frame, &relevant);
+	transform_frame_write(p, frame, base, &relevant, &transform_view);
+	transform_snapshot_pack(transform_view, view);
+	for (s32 index = relevant.start; index < relevant.end; index = relevant.next(index))
+	{
+		if (relevant.get(index))
+			client->view.priority[index] = 0.0f;
+	}
+
 	packet_finalize(p);
 	return true;
 }
@@ -1315,6 +2529,11 @@ void tick(const Update& u)
 {
 	if (mode == Mode::Active)
 		msgs_out_consolidate();
+
+	TransformFrame* frame = &transform_frame;
+	transform_frame_build(frame);
+	relevance_grid_build(frame);
+
 	StreamWrite p;
 	for (s32 i = 0; i < clients.length; i++)
 	{
@@ -1323,13 +2542,15 @@ void tick(const Update& u)
 		if (client->timeout > TIMEOUT)
 		{
 			vi_debug("Client %s:%hd timed out.", Sock::host_to_str(client->address.host), client->address.port);
+			player_remove(client);
+			client->~Client();
 			clients.remove(i);
 			i--;
 		}
 		else if (client->connected)
 		{
 			p.reset();
-			build_packet_update(&p, client);
+			build_packet_update(&p, client, frame);
 			packet_send(p, clients[i].address);
 		}
 	}
@@ -1368,18 +2589,8 @@ b8 packet_handle(const Update& u, StreamRead* p, const Sock::Address& address)
 	{
 		case ClientPacket::Connect:
 		{
-			if (clients.length < expected_clients)
+			if (client || (clients.length < expected_clients && player_slot_available()))
 			{
-				Client* client = nullptr;
-				for (s32 i = 0; i < clients.length; i++)
-				{
-					if (clients[i].address.equals(address))
-					{
-						client = &clients[i];
-						break;
-					}
-				}
-
 				if (!client)
 				{
 					client = clients.add();
@@ -1409,8 +2620,20 @@ b8 packet_handle(const Update& u, StreamRead* p, const Sock::Address& address)
 
 			if (client && !client->connected)
 			{
-				vi_debug("Client %s:%hd connected.", Sock::host_to_str(address.host), address.port);
-				client->connected = true;
+				if (PlayerManager::list.count() < MAX_PLAYERS)
+				{
+					vi_debug("Client %s:%hd connected.", Sock::host_to_str(address.host), address.port);
+					client->connected = true;
+					player_add(client);
+				}
+				else
+				{
+					// a level-loaded manager took the slot we reserved at connect
+					vi_debug("Refusing client %s:%hd; no player slots left.", Sock::host_to_str(address.host), address.port);
+					client->~Client();
+					clients.remove(client - clients.data);
+					break;
+				}
 			}
 
 			if (connected_clients() == expected_clients)
@@ -1440,6 +2663,22 @@ b8 packet_handle(const Update& u, StreamRead* p, const Sock::Address& address)
 				net_error();
 			calculate_rtt(Game::real_time.total, client->ack, msgs_out_history, &client->rtt);
 
+			b8 has_transform_ack;
+			serialize_bool(p, has_transform_ack);
+			if (has_transform_ack)
+			{
+				SequenceID transform_ack;
+				serialize_int(p, SequenceID, transform_ack, 0, SEQUENCE_COUNT - 1);
+				if (!client->transform_acked || sequence_more_recent(transform_ack, client->transform_ack))
+				{
+					client->transform_ack = transform_ack;
+					client->transform_acked = true;
+				}
+			}
+
+			if (!commands_read(u, p, client))
+				net_error();
+
 			client->timeout = 0.0f;
 			break;
 		}
@@ -1455,6 +2694,409 @@ b8 packet_handle(const Update& u, StreamRead* p, const Sock::Address& address)
 
 }
 
+// headless load testing.
+// each virtual client speaks just enough of the protocol to hold a connection open:
+// it acks everything, sends scripted input every tick, and never decodes the world.
+namespace Swarm
+{
+
+#define SWARM_RETRY 0.25f
+#define SWARM_REPORT_INTERVAL 1.0f
+
+enum class State
+{
+	Connecting,
+	Acking,
+	Connected,
+	Disconnected,
+};
+
+struct VirtualClient
+{
+	Sock::Handle sock;
+	State state;
+	r32 timeout;
+	r32 retry_timer;
+	r32 connect_start;
+	r32 connect_time; // when we received our first update
+	r32 rtt = 0.5f;
+	MessageHistory msgs_in_history;
+	MessageHistory msgs_out_history;
+	SequenceHistory recently_resent;
+	Ack server_ack = { u32(-1), 0 };
+	SequenceID local_sequence_id = 1;
+	SequenceID transform_ack; // we don't decode transforms, but ack them as if we did so the server sends deltas
+	b8 transform_acked;
+	StaticArray<AwkCommand, COMMAND_REDUNDANCY> commands; // most recent first
+	CommandID command_id;
+	Vec3 movement;
+	r32 movement_timer;
+	s32 updates; // update packets received
+	s32 resends; // message frames the server sent us more than once
+	s64 bytes_in;
+	s64 bytes_out;
+};
+
+Array<VirtualClient> clients;
+Sock::Address server_address;
+
+void send(VirtualClient* c, const StreamWrite& p)
+{
+	c->bytes_out += p.bytes_written();
+	Sock::udp_send(&c->sock, server_address, p.data.data, p.bytes_written());
+}
+
+// every sequence needs a message frame, even if it's just a noop
+b8 msgs_out_noop(VirtualClient* c)
+{
+	using Stream = StreamWrite;
+
+	StreamWrite msg;
+	MessageType type = MessageType::Noop;
+	serialize_enum(&msg, MessageType, type);
+	msg.flush();
+	s32 bytes = msg.bytes_written();
+
+	MessageFrame* frame = msg_history_add(&c->msgs_out_history, Game::real_time.total, bytes);
+	frame->sequence_id = c->local_sequence_id;
+	serialize_int(&frame->write, s32, bytes, 0, MAX_MESSAGES_SIZE);
+	serialize_int(&frame->write, SequenceID, frame->sequence_id, 0, SEQUENCE_COUNT - 1);
+	serialize_bytes(&frame->write, (u8*)msg.data.data, bytes);
+	return true;
+}
+
+// wander in a random direction, changing course every so often
+void input_generate(VirtualClient* c)
+{
+	c->movement_timer -= TICK_RATE;
+	if (c->movement_timer < 0.0f)
+	{
+		r32 angle = mersenne::randf_co() * PI * 2.0f;
+		c->movement = Vec3(cosf(angle), 0, sinf(angle));
+		c->movement_timer = 0.5f + mersenne::randf_co() * 1.5f;
+	}
+
+	if (c->commands.length == c->commands.capacity())
+		c->commands.remove(c->commands.length - 1);
+	c->command_id++;
+	AwkCommand* cmd = c->commands.insert(0);
+	cmd->movement = c->movement;
+	cmd->dt = TICK_RATE;
+	cmd->id = c->command_id;
+}
+
+b8 build_packet_update(StreamWrite* p, VirtualClient* c)
+{
+	packet_init(p);
+	using Stream = StreamWrite;
+	ClientPacket type = ClientPacket::Update;
+	serialize_enum(p, ClientPacket, type);
+
+	Ack ack = msg_history_ack(c->msgs_in_history);
+	serialize_int(p, SequenceID, ack.sequence_id, 0, SEQUENCE_COUNT - 1);
+	serialize_u32(p, ack.previous_sequences);
+
+	msgs_write(p, c->msgs_out_history, c->server_ack, &c->recently_resent, c->rtt);
+
+	serialize_bool(p, c->transform_acked);
+	if (c->transform_acked)
+		serialize_int(p, SequenceID, c->transform_ack, 0, SEQUENCE_COUNT - 1);
+
+	s32 count = c->commands.length;
+	serialize_int(p, s32, count, 0, COMMAND_REDUNDANCY);
+	if (count > 0)
+	{
+		serialize_u16(p, c->command_id);
+		for (s32 i = count - 1; i >= 0; i--)
+		{
+			if (!serialize_command(p, &c->commands[i]))
+				net_error();
+		}
+	}
+
+	packet_finalize(p);
+	return true;
+}
+
+b8 build_packet_simple(StreamWrite* p, ClientPacket type)
+{
+	packet_init(p);
+	using Stream = StreamWrite;
+	serialize_enum(p, ClientPacket, type);
+	packet_finalize(p);
+	return true;
+}
+
+void tick(VirtualClient* c)
+{
+	c->timeout += TICK_RATE;
+	c->retry_timer += TICK_RATE;
+	StreamWrite p;
+	switch (c->state)
+	{
+		case State::Connecting:
+		case State::Acking:
+		{
+			if (c->retry_timer > SWARM_RETRY)
+			{
+				c->retry_timer = 0.0f;
+				build_packet_simple(&p, c->state == State::Connecting ? ClientPacket::Connect : ClientPacket::AckInit);
+				send(c, p);
+			}
+			break;
+		}
+		case State::Connected:
+		{
+			if (c->timeout > TIMEOUT)
+			{
+				c->state = State::Disconnected;
+				break;
+			}
+			msgs_out_noop(c);
+			input_generate(c);
+			build_packet_update(&p, c);
+			send(c, p);
+			c->local_sequence_id = sequence_advance(c->local_sequence_id, 1);
+			break;
+		}
+		case State::Disconnected:
+		{
+			break;
+		}
+		default:
+		{
+			vi_assert(false);
+			break;
+		}
+	}
+}
+
+b8 packet_handle(VirtualClient* c, StreamRead* p)
+{
+	using Stream = StreamRead;
+	if (!p->read_checksum())
+		net_error();
+	ServerPacket type;
+	serialize_enum(p, ServerPacket, type);
+	switch (type)
+	{
+		case ServerPacket::Init:
+		{
+			if (c->state == State::Connecting)
+			{
+				c->state = State::Acking;
+				c->retry_timer = SWARM_RETRY; // ack right away
+			}
+			break;
+		}
+		case ServerPacket::Keepalive:
+		{
+			c->timeout = 0.0f;
+			break;
+		}
+		case ServerPacket::Update:
+		{
+			if (c->state == State::Acking)
+			{
+				c->state = State::Connected;
+				c->connect_time = Game::real_time.total;
+			}
+			if (c->state != State::Connected)
+				break;
+
+			s32 frames;
+			if (!msgs_read(p, &c->msgs_in_history, &c->server_ack, &frames))
+				net_error();
+			calculate_rtt(Game::real_time.total, c->server_ack, c->msgs_out_history, &c->rtt);
+			// the server resends old frames ahead of the current one
+			c->resends += vi_max(0, frames - 1);
+			c->updates++;
+			c->timeout = 0.0f;
+
+			CommandID command_ack;
+			serialize_u16(p, command_ack);
+			SequenceID transform_sequence_id;
+			serialize_int(p, SequenceID, transform_sequence_id, 0, SEQUENCE_COUNT - 1);
+			if (!c->transform_acked || sequence_more_recent(transform_sequence_id, c->transform_ack))
+			{
+				c->transform_ack = transform_sequence_id;
+				c->transform_acked = true;
+			}
+			// the rest is the transforms themselves, which we don't care about
+			break;
+		}
+		default:
+		{
+			net_error();
+		}
+	}
+	return true;
+}
+
+void receive(VirtualClient* c)
+{
+	while (true)
+	{
+		Sock::Address address;
+		StreamRead p;
+		s32 bytes = Sock::udp_receive(&c->sock, &address, p.data.data, MAX_PACKET_SIZE);
+		if (bytes <= 0)
+			break;
+		if (!address.equals(server_address))
+			continue;
+		c->bytes_in += bytes;
+		p.resize_bytes(bytes);
+		if (packet_decompress(&p, bytes))
+			packet_handle(c, &p);
+	}
+}
+
+// sorts in place
+r32 percentile(Array<r32>* values, r32 p)
+{
+	if (values->length == 0)
+		return 0.0f;
+	for (s32 i = 1; i < values->length; i++)
+	{
+		r32 v = (*values)[i];
+		s32 j = i - 1;
+		for (; j >= 0 && (*values)[j] > v; j--)
+			(*values)[j + 1] = (*values)[j];
+		(*values)[j + 1] = v;
+	}
+	return (*values)[vi_min(values->length - 1, s32(p * r32(values->length)))];
+}
+
+void percentiles_print(const char* caption, Array<r32>* values)
+{
+	printf("%s | p50: %.1f p90: %.1f p99: %.1f max: %.1f\n",
+		caption,
+		percentile(values, 0.5f),
+		percentile(values, 0.9f),
+		percentile(values, 0.99f),
+		percentile(values, 1.0f));
+}
+
+void status_print()
+{
+	s32 connected = 0;
+	r32 rtt = 0.0f;
+	for (s32 i = 0; i < clients.length; i++)
+	{
+		if (clients[i].state == State::Connected)
+		{
+			connected++;
+			rtt += clients[i].rtt;
+		}
+	}
+	printf("%.0fs | %d/%d connected | avg rtt %.0fms\n", Game::real_time.total, connected, clients.length, connected > 0 ? (rtt / r32(connected)) * 1000.0f : 0.0f);
+}
+
+void report_print()
+{
+	Array<r32> connect_latency;
+	Array<r32> update_rate;
+	Array<r32> resend_rate;
+	Array<r32> bandwidth_in;
+	Array<r32> bandwidth_out;
+	s32 connected = 0;
+	s32 dropped = 0;
+	s32 resends = 0;
+	for (s32 i = 0; i < clients.length; i++)
+	{
+		const VirtualClient& c = clients[i];
+		if (c.state == State::Disconnected)
+			dropped++;
+		if (c.updates == 0)
+			continue;
+		connected++;
+		resends += c.resends;
+		r32 duration = vi_max(TICK_RATE, Game::real_time.total - c.connect_time);
+		connect_latency.add(1000.0f * (c.connect_time - c.connect_start));
+		update_rate.add(r32(c.updates) / duration);
+		resend_rate.add(r32(c.resends) / duration);
+		bandwidth_in.add(r32(c.bytes_in) / (duration * 1024.0f));
+		bandwidth_out.add(r32(c.bytes_out) / (duration * 1024.0f));
+	}
+
+	printf("%d clients | %d connected | %d timed out | %d frames resent\n", clients.length, connected, dropped, resends);
+	percentiles_print("Connect latency (ms)", &connect_latency);
+	percentiles_print("Updates received (/s)", &update_rate);
+	percentiles_print("Resends received (/s)", &resend_rate);
+	percentiles_print("Bandwidth in (KB/s)", &bandwidth_in);
+	percentiles_print("Bandwidth out (KB/s)", &bandwidth_out);
+}
+
+// spawns count clients at ramp clients per second, runs for duration seconds, then reports.
+// the server needs to be expecting count clients.
+s32 run(const char* host, u16 port, s32 count, r32 ramp, r32 duration)
+{
+	if (Sock::init())
+	{
+		fprintf(stderr, "%s\n", Sock::get_error());
+		return 1;
+	}
+	compressor_init();
+	Sock::get_address(&server_address, host, port);
+
+	clients.reserve(count);
+
+	r64 start = platform::time();
+	r64 next_tick = start;
+	r32 report_timer = 0.0f;
+	while (Game::real_time.total < duration)
+	{
+		// spawn new clients
+		while (clients.length < count && r32(clients.length) < ramp * Game::real_time.total + 1.0f)
+		{
+			VirtualClient* c = clients.add();
+			new (c) VirtualClient();
+			if (Sock::udp_open(&c->sock, 0, true))
+			{
+				fprintf(stderr, "%s\n", Sock::get_error());
+				clients.remove(clients.length - 1);
+				count = clients.length; // out of sockets; make do with what we have
+				break;
+			}
+			c->connect_start = Game::real_time.total;
+			c->retry_timer = SWARM_RETRY; // connect right away
+		}
+
+		for (s32 i = 0; i < clients.length; i++)
+			receive(&clients[i]);
+
+		for (s32 i = 0; i < clients.length; i++)
+			tick(&clients[i]);
+
+		report_timer += TICK_RATE;
+		if (report_timer > SWARM_REPORT_INTERVAL)
+		{
+			report_timer = 0.0f;
+			status_print();
+		}
+
+		next_tick += TICK_RATE;
+		r64 now = platform::time();
+		if (next_tick > now)
+			platform::sleep(r32(next_tick - now));
+		else
+			next_tick = now; // we fell behind; don't try to catch up
+
+		Game::real_time.delta = TICK_RATE;
+		Game::real_time.total = r32(platform::time() - start);
+	}
+
+	report_print();
+
+	for (s32 i = 0; i < clients.length; i++)
+		Sock::close(&clients[i].sock);
+	compressor_term();
+	Sock::netshutdown();
+	return 0;
+}
+
+}
+
 #else
 
 namespace Client
@@ -1477,6 +3119,14 @@ SequenceHistory server_recently_resent; // sequences we recently resent to the s
 r32 server_rtt = 0.5f;
 SequenceID server_processed_sequence_id; // most recent sequence ID we've processed from the server
 TransformHistory transform_history;
+TransformFrame transform_frames[2]; // scratch space for reading and interpolating frames
+r32 interpolation_delay = INTERPOLATION_DELAY;
+r32 arrival_offset; // smoothed difference between when a frame arrives and when the server sent it
+r32 arrival_jitter; // mean deviation of frame arrival times from arrival_offset
+s32 arrival_ticks; // server ticks since the first frame we received
+StaticArray<AwkCommand, COMMAND_BUFFER> commands; // sent to the server but not yet acknowledged, oldest first
+CommandID command_id; // most recent command we've sent
+Ref<Entity> predicted; // our own awk, which we simulate ahead of the server
 
 b8 init()
 {
@@ -1525,10 +3175,85 @@ b8 build_packet_update(StreamWrite* p)
 	serialize_u32(p, ack.previous_sequences);
 
 	msgs_write(p, msgs_out_history, server_ack, &server_recently_resent, server_rtt);
+
+	// most recent transform frame we managed to reconstruct; the server deltas against it
+	b8 has_transform_ack = !transform_history.empty;
+	serialize_bool(p, has_transform_ack);
+	if (has_transform_ack)
+		serialize_int(p, SequenceID, transform_history.most_recent, 0, SEQUENCE_COUNT - 1);
+
+	// most recent input commands
+	s32 count = vi_min(s32(COMMAND_REDUNDANCY), s32(commands.length));
+	serialize_int(p, s32, count, 0, COMMAND_REDUNDANCY);
+	if (count > 0)
+	{
+		serialize_u16(p, command_id);
+		for (s32 i = commands.length - count; i < commands.length; i++)
+		{
+			if (!serialize_command(p, &commands[i]))
+				net_error();
+		}
+	}
+
 	packet_finalize(p);
 	return true;
 }
 
+// record a frame of input for our awk.
+// movement and dt are quantized in place so we simulate exactly what the server will.
+void awk_command(Entity* e, Vec3* movement, r32* dt)
+{
+	if (mode != Mode::Connected)
+		return;
+
+	predicted = e;
+
+	r32 length = movement->length();
+	if (length > 1.0f) // the awk crawls at full speed beyond this anyway
+		*movement /= length;
+
+	if (commands.length == commands.capacity())
+		commands.remove_ordered(0); // the server is way behind; drop the oldest
+
+	command_id++;
+	AwkCommand* c = commands.add();
+	c->id = command_id;
+	c->movement = *movement;
+	c->dt = *dt;
+	command_quantize(c);
+	*movement = c->movement;
+	*dt = c->dt;
+}
+
+// rewind our awk to the server's version of it, then replay whatever input the server hasn't simulated yet
+void reconcile(const Update& u, const TransformFrame& frame, CommandID ack)
+{
+	s32 acked = 0;
+	while (acked < commands.length && !command_more_recent(commands[acked].id, ack))
+		acked++;
+	if (acked > 0)
+	{
+		memmove(&commands[0], &commands[acked], sizeof(AwkCommand) * (commands.length - acked));
+		commands.length -= acked;
+	}
+
+	Entity* e = predicted.ref();
+	if (!e)
+		return;
+
+	Transform* t = e->get<Transform>();
+	if (!frame.active.get(t->id()))
+		return;
+
+	const TransformState& s = frame.transforms[t->id()];
+	transform_state_dequantize(s, &t->pos, &t->rot);
+	t->parent = s.parent;
+
+	Awk* awk = e->get<Awk>();
+	for (s32 i = 0; i < commands.length; i++)
+		command_simulate(awk, commands[i], u);
+}
+
 b8 msg_process(StreamRead* p)
 {
 	using Stream = StreamRead;
@@ -1570,9 +3295,39 @@ b8 msg_process(StreamRead* p)
 	return true;
 }
 
+// frames arrive in bursts, so rather than stamping them with their arrival time,
+// space them out by server tick and track how far actual arrivals stray from that.
+// returns the timestamp the frame should play back at.
+r32 frame_arrived(SequenceID sequence_id)
+{
+	r32 now = Game::real_time.total;
+	if (transform_history.empty)
+	{
+		arrival_ticks = 0;
+		arrival_offset = now;
+		arrival_jitter = 0.0f;
+		return now;
+	}
+
+	arrival_ticks += sequence_relative_to(sequence_id, transform_history.most_recent);
+	r32 sent = r32(arrival_ticks) * TICK_RATE;
+	r32 deviation = (now - sent) - arrival_offset;
+	arrival_jitter += (fabsf(deviation) - arrival_jitter) * JITTER_SMOOTHING;
+	// limit how fast the offset moves so timestamps keep increasing even when a frame is very late
+	arrival_offset += vi_max(-TICK_RATE * 0.5f, vi_min(TICK_RATE * 0.5f, deviation * JITTER_SMOOTHING));
+
+	return vi_max(sent + arrival_offset, transform_history_most_recent(transform_history)->timestamp + TICK_RATE * 0.5f);
+}
+
 void update(const Update& u)
 {
-	r32 interpolation_time = Game::real_time.total - INTERPOLATION_DELAY;
+	// enough delay to have the next frame on hand, plus a buffer for jitter
+	{
+		r32 target = vi_max(TICK_RATE, vi_min(INTERPOLATION_DELAY_MAX, TICK_RATE + arrival_jitter * INTERPOLATION_JITTER_SCALE));
+		r32 slew = INTERPOLATION_DELAY_SLEW * Game::real_time.delta;
+		interpolation_delay += vi_max(-slew, vi_min(slew, target - interpolation_delay));
+	}
+	r32 interpolation_time = Game::real_time.total - interpolation_delay;
 
 	while (MessageFrame* frame = msg_frame_advance(&msgs_in_history, &server_processed_sequence_id, interpolation_time))
 	{
@@ -1588,31 +3343,31 @@ void update(const Update& u)
 		}
 	}
 
-	const TransformFrame* frame = transform_frame_by_timestamp(transform_history, interpolation_time);
-	if (frame)
+	const TransformSnapshot* snapshot = transform_history_by_timestamp(transform_history, interpolation_time);
+	if (snapshot)
 	{
-		const TransformFrame* frame_next = transform_frame_next(transform_history, *frame);
-		const TransformFrame* frame_final;
-		TransformFrame interpolated;
-		if (frame_next)
+		// our own awk is predicted, not interpolated
+		ID skip = predicted.ref() ? predicted.ref()->get<Transform>()->id() : IDNull;
+		transform_snapshot_expand(*snapshot, &transform_frames[0]);
+		const TransformSnapshot* snapshot_next = transform_history_next(transform_history, *snapshot);
+		const TransformSnapshot* snapshot_previous;
+		if (snapshot_next)
 		{
-			transform_frame_interpolate(*frame, *frame_next, &interpolated, interpolation_time);
-			frame_final = &interpolated;
+			transform_snapshot_expand(*snapshot_next, &transform_frames[1]);
+			r32 blend = vi_min((interpolation_time - snapshot->timestamp) / (snapshot_next->timestamp - snapshot->timestamp), 1.0f);
+			transform_frame_apply(transform_frames[0], &transform_frames[1], blend, skip);
 		}
-		else
-			frame_final = frame;
-
-		// apply frame_final to world
-		s32 index = frame_final->active.start;
-		for (s32 i = 0; i < frame_final->count; i++)
+		else if (interpolation_time - snapshot->timestamp < EXTRAPOLATION_MAX
+			&& (snapshot_previous = transform_history_previous(transform_history, *snapshot)))
 		{
-			Transform* t = &Transform::list[index];
-			const TransformState& s = frame_final->transforms[index];
-			t->pos = s.pos;
-			t->rot = s.rot;
-			t->parent = s.parent;
-			index = frame_final->active.next(index);
+			// we ran out of frames; keep things moving along their last known path for a little while
+			transform_snapshot_expand(*snapshot, &transform_frames[1]);
+			transform_snapshot_expand(*snapshot_previous, &transform_frames[0]);
+			r32 blend = (interpolation_time - snapshot_previous->timestamp) / (snapshot->timestamp - snapshot_previous->timestamp);
+			transform_frame_apply(transform_frames[0], &transform_frames[1], blend, skip);
 		}
+		else
+			transform_frame_apply(transform_frames[0], nullptr, 0.0f, skip);
 	}
 }
 
@@ -1737,15 +3492,19 @@ b8 packet_handle(const Update& u, StreamRead* p, const Sock::Address& address)
 				net_error();
 			calculate_rtt(Game::real_time.total, server_ack, msgs_out_history, &server_rtt);
 
+			CommandID command_ack;
+			serialize_u16(p, command_ack);
+
 			{
-				SequenceID base_sequence_id;
-				serialize_int(p, SequenceID, base_sequence_id, 0, SEQUENCE_COUNT - 1);
-				const TransformFrame* base = transform_frame_by_sequence(transform_history, base_sequence_id);
-				TransformFrame frame;
-				transform_frame_read(p, &frame, base);
+				TransformFrame* frame = &transform_frames[0];
 				// only insert the frame into the history if it is more recent
-				if (transform_history.frames.length == 0 || sequence_more_recent(frame.sequence_id, transform_history.frames[transform_history.current_index].sequence_id))
-					memcpy(transform_frame_add(&transform_history), &frame, sizeof(TransformFrame));
+				if (transform_frame_read(p, frame, transform_history)
+					&& (transform_history.empty || sequence_more_recent(frame->sequence_id, transform_history.most_recent)))
+				{
+					frame->timestamp = frame_arrived(frame->sequence_id);
+					transform_snapshot_pack(*frame, transform_history_add(&transform_history, frame->sequence_id));
+					reconcile(u, *frame, command_ack);
+				}
 			}
 
 			timeout = 0.0f; // reset connection timeout
@@ -1770,11 +3529,21 @@ b8 init()
 	if (Sock::init())
 		return false;
 
+	compressor_init();
+
+	if (!capture_open())
+		return false;
+
 #if SERVER
-	return Server::init();
+	if (!Server::init())
+		return false;
 #else
-	return Client::init();
+	if (!Client::init())
+		return false;
 #endif
+
+	io_start();
+	return true;
 }
 
 b8 finalize(Entity* e)
@@ -1816,19 +3585,23 @@ void update(const Update& u)
 	{
 		Sock::Address address;
 		StreamRead incoming_packet;
-		s32 bytes_received = Sock::udp_receive(&sock, &address, incoming_packet.data.data, MAX_PACKET_SIZE);
+		s32 bytes_received = packet_receive(&address, &incoming_packet);
 		if (bytes_received > 0)
 		{
 			//if (mersenne::randf_co() < 0.75f) // packet loss simulation
 			{
 				incoming_packet.resize_bytes(bytes_received);
 
-				packet_decompress(&incoming_packet, bytes_received);
+				if (packet_decompress(&incoming_packet, bytes_received))
+				{
 #if SERVER
-				Server::packet_handle(u, &incoming_packet, address);
+					Server::packet_handle(u, &incoming_packet, address);
 #else
-				Client::packet_handle(u, &incoming_packet, address);
+					Client::packet_handle(u, &incoming_packet, address);
 #endif
+				}
+				else
+					vi_debug("%s", "Discarding packet due to invalid compression.");
 			}
 		}
 		else
@@ -1842,7 +3615,7 @@ void update(const Update& u)
 #endif
 
 	tick_timer += Game::real_time.delta;
-	if (tick_timer > TICK_RATE)
+	if (tick_timer >= TICK_RATE)
 	{
 		tick_timer = 0.0f;
 
@@ -1852,11 +3625,25 @@ void update(const Update& u)
 		Client::tick(u);
 #endif
 	}
+
+	packet_flush();
+
+	if (capture.replay)
+		replay_update();
+
+#if NET_THREAD
+	s32 dropped = io.dropped.exchange(0);
+	if (dropped > 0)
+		vi_debug("Dropped %d incoming packets; receive queue full.", dropped);
+#endif
 }
 
 void term()
 {
+	io_stop();
 	Sock::close(&sock);
+	compressor_term();
+	capture_close();
 }
 
 StreamWrite* msg_new()
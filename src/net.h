@@ -8,6 +8,7 @@ namespace VI
 {
 
 struct Entity;
+struct Vec3;
 
 namespace Sock
 {
@@ -23,6 +24,11 @@ struct StreamWrite;
 // borrows heavily from https://github.com/networkprotocol/libyojimbo
 
 #define MAX_PACKET_SIZE 1500
+#define TICK_RATE (1.0f / 60.0f)
+#define NET_SERVER_PORT 3494
+
+extern const char* capture_path; // if set, record every datagram to this file
+extern const char* replay_path; // if set, feed incoming datagrams from this capture instead of the socket, as fast as possible
 
 b8 init();
 void update(const Update&);
@@ -32,11 +38,20 @@ b8 remove(Entity*);
 #if SERVER
 namespace Server
 {
+	extern u16 port;
+	extern AssetID level;
+	extern s32 expected_clients;
+}
+
+namespace Swarm
+{
+	s32 run(const char*, u16, s32, r32, r32);
 }
 #else
 namespace Client
 {
 	void connect(const char*, u16);
+	void awk_command(Entity*, Vec3*, r32*);
 }
 #endif
 
@@ -44,14 +44,75 @@ static const u32 crc32_table[256] =
 	0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d 
 };
 
+// slice-by-8: table[k][i] is the CRC of byte i followed by k zero bytes,
+// which lets us fold in eight bytes per step with independent lookups
+struct Crc32Slices
+{
+	u32 table[8][256];
+
+	Crc32Slices()
+	{
+		for (s32 i = 0; i < 256; i++)
+			table[0][i] = crc32_table[i];
+		for (s32 k = 1; k < 8; k++)
+		{
+			for (s32 i = 0; i < 256; i++)
+				table[k][i] = (table[k - 1][i] >> 8) ^ crc32_table[table[k - 1][i] & 0xFF];
+		}
+	}
+};
+
+static const Crc32Slices crc32_slices;
+
+// assumes a little-endian host, like the rest of the packet code
 u32 crc32(const u8* buffer, memory_index length, u32 value)
 {
+	const u32 (*t)[256] = crc32_slices.table;
 	value ^= 0xFFFFFFFF;
-	for (memory_index i = 0; i < length; i++) 
+	while (length >= 8)
+	{
+		u32 a;
+		u32 b;
+		memcpy(&a, buffer, sizeof(u32));
+		memcpy(&b, buffer + sizeof(u32), sizeof(u32));
+		a ^= value;
+		value = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24]
+			^ t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+		buffer += 8;
+		length -= 8;
+	}
+	for (memory_index i = 0; i < length; i++)
 		value = (value >> 8) ^ crc32_table[(value ^ buffer[i]) & 0xFF];
 	return value ^ 0xFFFFFFFF;
 }
 
+// helpers for the bulk bit packers. these keep the scratch word in registers
+// instead of going through the stream for every field.
+inline void bits_push(u64* scratch, s32* scratch_bits, u32** out, u32 value, s32 bits)
+{
+	*scratch |= u64(value) << *scratch_bits;
+	*scratch_bits += bits;
+	if (*scratch_bits >= 32)
+	{
+		*(*out)++ = u32(*scratch & 0xFFFFFFFF);
+		*scratch >>= 32;
+		*scratch_bits -= 32;
+	}
+}
+
+inline u32 bits_pull(u64* scratch, s32* scratch_bits, const u32** in, s32 bits)
+{
+	if (*scratch_bits < bits)
+	{
+		*scratch |= u64(*(*in)++) << *scratch_bits;
+		*scratch_bits += 32;
+	}
+	u32 value = u32(*scratch & ((u64(1) << bits) - 1));
+	*scratch >>= bits;
+	*scratch_bits -= bits;
+	return value;
+}
+
 StreamWrite::StreamWrite()
 	: data(),
 	scratch(),
@@ -84,6 +145,39 @@ void StreamWrite::bits(u32 value, s32 bits)
 	}
 }
 
+// same bits as calling bits() on each value in turn, low 32 bits first
+void StreamWrite::bits_bulk(const u64* values, s32 count, s32 bits)
+{
+	vi_assert(bits > 0);
+	vi_assert(bits <= 64);
+	vi_assert(data.length + (scratch_bits + count * bits) / 32 <= s32(data.capacity()));
+
+	u64 s = scratch;
+	s32 s_bits = scratch_bits;
+	u32* out = &data.data[data.length];
+	if (bits > 32)
+	{
+		s32 hi_bits = bits - 32;
+		for (s32 i = 0; i < count; i++)
+		{
+			vi_assert(bits == 64 || (values[i] >> bits) == 0);
+			bits_push(&s, &s_bits, &out, u32(values[i] & 0xFFFFFFFF), 32);
+			bits_push(&s, &s_bits, &out, u32(values[i] >> 32), hi_bits);
+		}
+	}
+	else
+	{
+		for (s32 i = 0; i < count; i++)
+		{
+			vi_assert((values[i] >> bits) == 0);
+			bits_push(&s, &s_bits, &out, u32(values[i]), bits);
+		}
+	}
+	scratch = s;
+	scratch_bits = s_bits;
+	data.length = s32(out - data.data);
+}
+
 b8 StreamWrite::align()
 {
 	const int remainder_bits = scratch_bits % 8;
@@ -241,6 +335,35 @@ void StreamRead::bits(u32& output, s32 bits)
 	scratch_bits -= bits;
 }
 
+void StreamRead::bits_bulk(u64* values, s32 count, s32 bits)
+{
+	vi_assert(bits > 0);
+	vi_assert(bits <= 64);
+	vi_assert(bits_read + count * bits <= data.length * 32);
+
+	u64 s = scratch;
+	s32 s_bits = scratch_bits;
+	const u32* in = &data.data[(bits_read + scratch_bits) / 32];
+	if (bits > 32)
+	{
+		s32 hi_bits = bits - 32;
+		for (s32 i = 0; i < count; i++)
+		{
+			u64 lo = bits_pull(&s, &s_bits, &in, 32);
+			u64 hi = bits_pull(&s, &s_bits, &in, hi_bits);
+			values[i] = (hi << 32) | lo;
+		}
+	}
+	else
+	{
+		for (s32 i = 0; i < count; i++)
+			values[i] = bits_pull(&s, &s_bits, &in, bits);
+	}
+	scratch = s;
+	scratch_bits = s_bits;
+	bits_read += count * bits;
+}
+
 void StreamRead::bytes(u8* buffer, s32 bytes)
 {
 	vi_assert(align_bits() == 0);
@@ -18,6 +18,26 @@ namespace Net
 
 u32 crc32(const u8*, memory_index, u32 value = 0);
 
+// traffic capture file format; see net.cpp. yearningbench reads these too.
+#define CAPTURE_MAGIC 0x50434956 // "VICP"
+#define CAPTURE_VERSION 1
+
+enum class CaptureDirection : u8
+{
+	In,
+	Out,
+};
+
+struct CaptureRecord
+{
+	r32 timestamp;
+	u32 host;
+	u16 port;
+	CaptureDirection direction;
+	u8 padding;
+	s32 size;
+};
+
 template <u32 x> struct PopCount
 {
 	enum
@@ -62,6 +82,7 @@ struct StreamWrite
 	StreamWrite();
 	b8 would_overflow(s32) const;
 	void bits(u32, s32);
+	void bits_bulk(const u64*, s32, s32);
 	void bytes(const u8*, s32);
 	s32 bits_written() const;
 	s32 bytes_written() const;
@@ -86,6 +107,7 @@ struct StreamRead
 	b8 read_checksum();
 	b8 would_overflow(s32) const;
 	void bits(u32&, s32);
+	void bits_bulk(u64*, s32, s32);
 	void bytes(u8*, s32);
 	s32 align_bits() const;
 	b8 align();
@@ -194,6 +216,16 @@ inline int bits_required(u32 min, u32 max)
 	(stream)->bits(value, count);\
 }
 
+// a run of fixed-width fields, up to 64 bits each
+#define serialize_bulk(stream, values, count, bits)\
+{\
+	vi_assert(bits > 0);\
+	vi_assert(bits <= 64);\
+	if (!Stream::IsWriting && (stream)->would_overflow((count) * (bits)))\
+		net_error();\
+	(stream)->bits_bulk(values, count, bits);\
+}
+
 #define serialize_enum(stream, type, value) serialize_int(stream, type, value, 0, s32(type::count) - 1)
 #define serialize_u8(stream, value) serialize_int(stream, u8, value, 0, 255)
 #define serialize_u16(stream, value) serialize_int(stream, u16, value, 0, 65535)
@@ -0,0 +1,425 @@
+#include "types.h"
+#include "net_serialize.h"
+#include "assimp/contrib/zlib/zlib.h"
+#include "fastlz/fastlz.h"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// micro-benchmarks for the hot paths of packet building, checksumming and compression.
+// yearningbench [iterations] [capture]
+// the codec comparison needs a capture recorded with yearningsrv --capture.
+
+namespace VI
+{
+
+namespace Bench
+{
+
+r64 time()
+{
+	return (r64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 1000000000.0;
+}
+
+// the original byte-at-a-time implementation, for comparison
+u32 crc32_bytewise(const u8* buffer, memory_index length, u32 value)
+{
+	static u32 table[256];
+	if (!table[1])
+	{
+		for (u32 i = 0; i < 256; i++)
+		{
+			u32 c = i;
+			for (s32 k = 0; k < 8; k++)
+				c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+			table[i] = c;
+		}
+	}
+	value ^= 0xFFFFFFFF;
+	for (memory_index i = 0; i < length; i++)
+		value = (value >> 8) ^ table[(value ^ buffer[i]) & 0xFF];
+	return value ^ 0xFFFFFFFF;
+}
+
+void report(const char* caption, r64 start, s32 iterations, s64 bytes, u32 checksum)
+{
+	r64 elapsed = time() - start;
+	printf("%-32s %8.3fus/iteration %10.1fMB/s (%08x)\n",
+		caption,
+		(elapsed / iterations) * 1000000.0,
+		(r64(bytes) * iterations) / (elapsed * 1024.0 * 1024.0),
+		checksum);
+}
+
+#define BENCH_FIELDS 1024 // roughly a full transform frame's worth of fields
+
+void run(s32 iterations)
+{
+	u8 packet[MAX_PACKET_SIZE];
+	for (s32 i = 0; i < MAX_PACKET_SIZE; i++)
+		packet[i] = u8(rand());
+
+	// checksums
+	{
+		u32 checksum = 0;
+		r64 start = time();
+		for (s32 i = 0; i < iterations; i++)
+			checksum += crc32_bytewise(packet, MAX_PACKET_SIZE, 0);
+		report("crc32 bytewise", start, iterations, MAX_PACKET_SIZE, checksum);
+
+		checksum = 0;
+		start = time();
+		for (s32 i = 0; i < iterations; i++)
+			checksum += Net::crc32(packet, MAX_PACKET_SIZE);
+		report("crc32 slice-by-8", start, iterations, MAX_PACKET_SIZE, checksum);
+	}
+
+	// bit packing, one run of fixed-width fields per width
+	const s32 widths[] = { 11, 29, 50 };
+	for (s32 w = 0; w < s32(sizeof(widths) / sizeof(widths[0])); w++)
+	{
+		s32 bits = widths[w];
+		s32 count = ((MAX_PACKET_SIZE - 8) * 8) / bits;
+		if (count > BENCH_FIELDS)
+			count = BENCH_FIELDS;
+		u64 values[BENCH_FIELDS];
+		u64 mask = (u64(1) << bits) - 1;
+		for (s32 i = 0; i < count; i++)
+			values[i] = ((u64(rand()) << 32) ^ u64(rand())) & mask;
+		s64 bytes = (s64(count) * bits) / 8;
+
+		char caption[64];
+		Net::StreamWrite p;
+		u32 checksum = 0;
+
+		sprintf(caption, "write %d-bit fields", bits);
+		r64 start = time();
+		for (s32 i = 0; i < iterations; i++)
+		{
+			p.reset();
+			for (s32 j = 0; j < count; j++)
+			{
+				p.bits(u32(values[j] & 0xFFFFFFFF), bits < 32 ? bits : 32);
+				if (bits > 32)
+					p.bits(u32(values[j] >> 32), bits - 32);
+			}
+			p.flush();
+			checksum += p.data[p.data.length / 2];
+		}
+		report(caption, start, iterations, bytes, checksum);
+
+		sprintf(caption, "write %d-bit fields in bulk", bits);
+		checksum = 0;
+		start = time();
+		for (s32 i = 0; i < iterations; i++)
+		{
+			p.reset();
+			p.bits_bulk(values, count, bits);
+			p.flush();
+			checksum += p.data[p.data.length / 2];
+		}
+		report(caption, start, iterations, bytes, checksum);
+
+		Net::StreamRead r;
+		r.data.length = p.data.length;
+		memcpy(r.data.data, p.data.data, p.data.length * sizeof(u32));
+		u64 results[BENCH_FIELDS];
+
+		sprintf(caption, "read %d-bit fields", bits);
+		checksum = 0;
+		start = time();
+		for (s32 i = 0; i < iterations; i++)
+		{
+			r.rewind();
+			for (s32 j = 0; j < count; j++)
+			{
+				u32 lo;
+				u32 hi = 0;
+				r.bits(lo, bits < 32 ? bits : 32);
+				if (bits > 32)
+					r.bits(hi, bits - 32);
+				results[j] = (u64(hi) << 32) | lo;
+			}
+			checksum += u32(results[count / 2]);
+		}
+		report(caption, start, iterations, bytes, checksum);
+
+		sprintf(caption, "read %d-bit fields in bulk", bits);
+		checksum = 0;
+		start = time();
+		for (s32 i = 0; i < iterations; i++)
+		{
+			r.rewind();
+			r.bits_bulk(results, count, bits);
+			checksum += u32(results[count / 2]);
+		}
+		report(caption, start, iterations, bytes, checksum);
+	}
+}
+
+struct Packet
+{
+	u8 data[MAX_PACKET_SIZE];
+	s32 size;
+};
+
+b8 packet_valid(const u8* data, s32 size)
+{
+	if (size < s32(sizeof(u32)) || size > MAX_PACKET_SIZE)
+		return false;
+	Net::StreamRead r;
+	r.resize_bytes(size);
+	memcpy(r.data.data, data, size);
+	return r.read_checksum();
+}
+
+// captures hold datagrams as they went over the wire.
+// recover the uncompressed packet, whichever codec the capture was recorded with.
+s32 packet_recover(const u8* in, s32 in_bytes, u8* out)
+{
+	if (packet_valid(in, in_bytes))
+	{
+		memcpy(out, in, in_bytes);
+		return in_bytes;
+	}
+
+	uLongf zlib_bytes = MAX_PACKET_SIZE;
+	if (uncompress(out, &zlib_bytes, in, in_bytes) == Z_OK && packet_valid(out, s32(zlib_bytes)))
+		return s32(zlib_bytes);
+
+	s32 fastlz_bytes = fastlz_decompress(in, in_bytes, out, MAX_PACKET_SIZE);
+	if (fastlz_bytes > 0 && packet_valid(out, fastlz_bytes))
+		return fastlz_bytes;
+
+	return -1;
+}
+
+// returns false if the file can't be read
+b8 capture_load(const char* path, Array<Packet>* packets)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return false;
+
+	u32 header[2];
+	if (fread(header, sizeof(header), 1, f) != 1
+		|| header[0] != CAPTURE_MAGIC
+		|| header[1] != CAPTURE_VERSION)
+	{
+		fclose(f);
+		return false;
+	}
+
+	s32 unrecognized = 0;
+	Net::CaptureRecord record;
+	u8 datagram[MAX_PACKET_SIZE];
+	while (fread(&record, sizeof(record), 1, f) == 1)
+	{
+		if (record.size < 0 || record.size > MAX_PACKET_SIZE)
+			break; // corrupt
+		if (record.size > 0 && fread(datagram, record.size, 1, f) != 1)
+			break;
+		Packet* packet = packets->add();
+		packet->size = packet_recover(datagram, record.size, packet->data);
+		if (packet->size < 0)
+		{
+			packets->remove(packets->length - 1);
+			unrecognized++;
+		}
+	}
+	fclose(f);
+
+	if (unrecognized > 0)
+		fprintf(stderr, "Skipped %d datagrams which didn't decode to a valid packet.\n", unrecognized);
+	return true;
+}
+
+// candidate codecs. zlib streams are kept around and reset between packets, the same as net.cpp does.
+z_stream zlib_deflaters[2];
+z_stream zlib_inflater;
+
+s32 zlib_compress(z_stream* z, const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	deflateReset(z);
+	z->next_in = (Bytef*)in;
+	z->avail_in = in_bytes;
+	z->next_out = (Bytef*)out;
+	z->avail_out = out_capacity;
+	return deflate(z, Z_FINISH) == Z_STREAM_END ? s32(out_capacity - z->avail_out) : -1;
+}
+
+s32 zlib_fast_compress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	return zlib_compress(&zlib_deflaters[0], in, in_bytes, out, out_capacity);
+}
+
+s32 zlib_default_compress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	return zlib_compress(&zlib_deflaters[1], in, in_bytes, out, out_capacity);
+}
+
+s32 zlib_decompress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	z_stream* z = &zlib_inflater;
+	inflateReset(z);
+	z->next_in = (Bytef*)in;
+	z->avail_in = in_bytes;
+	z->next_out = (Bytef*)out;
+	z->avail_out = out_capacity;
+	return inflate(z, Z_FINISH) == Z_STREAM_END ? s32(out_capacity - z->avail_out) : -1;
+}
+
+s32 fastlz_compress_with_level(s32 level, const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	// fastlz needs 5% extra room for incompressible data
+	u8 buffer[MAX_PACKET_SIZE * 2];
+	s32 out_bytes = fastlz_compress_level(level, in, in_bytes, buffer);
+	if (out_bytes > out_capacity)
+		return -1;
+	memcpy(out, buffer, out_bytes);
+	return out_bytes;
+}
+
+s32 fastlz1_compress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	return fastlz_compress_with_level(1, in, in_bytes, out, out_capacity);
+}
+
+s32 fastlz2_compress(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	return fastlz_compress_with_level(2, in, in_bytes, out, out_capacity);
+}
+
+s32 fastlz_decompress_packet(const u8* in, s32 in_bytes, u8* out, s32 out_capacity)
+{
+	s32 out_bytes = fastlz_decompress(in, in_bytes, out, out_capacity);
+	return out_bytes > 0 ? out_bytes : -1;
+}
+
+struct Codec
+{
+	const char* name;
+	s32 (*compress)(const u8*, s32, u8*, s32);
+	s32 (*decompress)(const u8*, s32, u8*, s32);
+};
+
+const Codec codecs[] =
+{
+	{ "zlib level 1", &zlib_fast_compress, &zlib_decompress },
+	{ "zlib default level", &zlib_default_compress, &zlib_decompress },
+	{ "fastlz level 1", &fastlz1_compress, &fastlz_decompress_packet },
+	{ "fastlz level 2", &fastlz2_compress, &fastlz_decompress_packet },
+};
+
+// compress and decompress every packet until at least `iterations` packets have gone through each codec.
+// packets which don't get smaller are counted as sent raw, the same as packet_finalize does.
+void run_codecs(s32 iterations, const Array<Packet>& packets)
+{
+	memset(zlib_deflaters, 0, sizeof(zlib_deflaters));
+	deflateInit(&zlib_deflaters[0], 1);
+	deflateInit(&zlib_deflaters[1], Z_DEFAULT_COMPRESSION);
+	memset(&zlib_inflater, 0, sizeof(zlib_inflater));
+	inflateInit(&zlib_inflater);
+
+	s32 passes = iterations / packets.length;
+	if (passes < 1)
+		passes = 1;
+	Array<Packet> compressed(packets.length, packets.length);
+	u8 scratch[MAX_PACKET_SIZE];
+
+	printf("%d packets\n", s32(packets.length));
+	for (s32 c = 0; c < s32(sizeof(codecs) / sizeof(codecs[0])); c++)
+	{
+		const Codec& codec = codecs[c];
+
+		// sizes and round trip
+		s64 bytes_in = 0;
+		s64 bytes_out = 0;
+		s32 raw = 0;
+		for (s32 i = 0; i < packets.length; i++)
+		{
+			const Packet& packet = packets[i];
+			Packet* c = &compressed[i];
+			c->size = codec.compress(packet.data, packet.size, c->data, MAX_PACKET_SIZE);
+			bytes_in += packet.size;
+			if (c->size < 0 || c->size >= packet.size)
+			{
+				c->size = -1;
+				bytes_out += packet.size;
+				raw++;
+				continue;
+			}
+			bytes_out += c->size;
+			s32 decompressed_bytes = codec.decompress(c->data, c->size, scratch, MAX_PACKET_SIZE);
+			if (decompressed_bytes != packet.size || memcmp(scratch, packet.data, packet.size) != 0)
+			{
+				printf("%-32s round trip failed on packet %d\n", codec.name, i);
+				return;
+			}
+		}
+
+		u32 checksum = 0;
+		r64 start = time();
+		for (s32 pass = 0; pass < passes; pass++)
+		{
+			for (s32 i = 0; i < packets.length; i++)
+				checksum += u32(codec.compress(packets[i].data, packets[i].size, scratch, MAX_PACKET_SIZE));
+		}
+		r64 compress_time = time() - start;
+
+		start = time();
+		for (s32 pass = 0; pass < passes; pass++)
+		{
+			for (s32 i = 0; i < compressed.length; i++)
+			{
+				if (compressed[i].size > 0)
+					checksum += u32(codec.decompress(compressed[i].data, compressed[i].size, scratch, MAX_PACKET_SIZE));
+			}
+		}
+		r64 decompress_time = time() - start;
+
+		r64 count = r64(passes) * r64(packets.length);
+		r64 decompress_count = r64(passes) * r64(packets.length - raw);
+		printf("%-32s %6.1f%% of original %8.3fus/packet compress %8.3fus/packet decompress %6d sent raw (%08x)\n",
+			codec.name,
+			100.0 * r64(bytes_out) / r64(bytes_in),
+			(compress_time / count) * 1000000.0,
+			decompress_count > 0.0 ? (decompress_time / decompress_count) * 1000000.0 : 0.0,
+			raw,
+			checksum);
+	}
+
+	deflateEnd(&zlib_deflaters[0]);
+	deflateEnd(&zlib_deflaters[1]);
+	inflateEnd(&zlib_inflater);
+}
+
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	VI::s32 iterations = argc > 1 ? VI::s32(atoi(argv[1])) : 10000;
+	if (iterations < 1)
+		iterations = 1;
+	VI::Bench::run(iterations);
+
+	if (argc > 2)
+	{
+		VI::Array<VI::Bench::Packet> packets;
+		if (!VI::Bench::capture_load(argv[2], &packets))
+		{
+			fprintf(stderr, "Can't read capture file %s.\n", argv[2]);
+			return 1;
+		}
+		if (packets.length == 0)
+		{
+			fprintf(stderr, "No packets in capture file %s.\n", argv[2]);
+			return 1;
+		}
+		VI::Bench::run_codecs(iterations, packets);
+	}
+	return 0;
+}
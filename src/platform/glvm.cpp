@@ -75,6 +75,10 @@ b8 compile_shader(const char* prefix, const char* code, s32 code_length, u32* pr
 	return success;
 }
 
+#define UNIFORM_CACHE_SIZE 64 // uniforms bigger than this are always uploaded
+#define MAX_TEXTURE_UNITS 16
+#define TEXTURE_UNIT_INVALID GLuint(-1)
+
 struct GLData
 {
 	struct Mesh
@@ -103,10 +107,18 @@ struct GLData
 		}
 	};
 
+	// last value uploaded to each uniform, so we can skip redundant uploads
+	struct UniformState
+	{
+		u8 value[UNIFORM_CACHE_SIZE];
+		s32 size;
+	};
+
 	struct ShaderTechnique
 	{
 		GLuint handle;
 		Array<GLuint> uniforms;
+		Array<UniformState> uniform_states;
 	};
 
 	typedef std::array<ShaderTechnique, (size_t)RenderTechnique::count> Shader;
@@ -140,6 +152,10 @@ struct GLData
 	static r32 line_width;
 	static AssetID current_framebuffer;
 	static Rect2 viewport;
+	static GLuint current_vertex_array;
+	static s32 active_texture_unit;
+	static GLuint texture_units[MAX_TEXTURE_UNITS];
+	static RenderStats stats;
 
 	static Array<char> uniform_name_buffer;
 	static Array<AssetID> uniform_names;
@@ -170,6 +186,10 @@ r32 GLData::point_size = 1.0f;
 r32 GLData::line_width = 1.0f;
 AssetID GLData::current_framebuffer = 0;
 Rect2 GLData::viewport = { Vec2::zero, Vec2::zero };
+GLuint GLData::current_vertex_array = 0;
+s32 GLData::active_texture_unit = 0;
+GLuint GLData::texture_units[MAX_TEXTURE_UNITS];
+RenderStats GLData::stats;
 
 void render_init()
 {
@@ -180,6 +200,65 @@ void render_init()
 	glEnable(GL_CULL_FACE);
 }
 
+void bind_vertex_array(GLuint handle)
+{
+	if (GLData::current_vertex_array == handle)
+		GLData::stats.vertex_arrays_skipped++;
+	else
+	{
+		glBindVertexArray(handle);
+		GLData::current_vertex_array = handle;
+		GLData::stats.vertex_arrays++;
+	}
+}
+
+void bind_texture(s32 unit, GLenum type, GLuint handle)
+{
+	vi_assert(unit < MAX_TEXTURE_UNITS);
+	if (GLData::texture_units[unit] == handle)
+		GLData::stats.textures_skipped++;
+	else
+	{
+		if (GLData::active_texture_unit != unit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			GLData::active_texture_unit = unit;
+		}
+		glBindTexture(type, handle);
+		GLData::texture_units[unit] = handle;
+		GLData::stats.textures++;
+	}
+}
+
+// something other than bind_texture touched the texture bindings
+void invalidate_texture_units()
+{
+	for (s32 i = 0; i < MAX_TEXTURE_UNITS; i++)
+		GLData::texture_units[i] = TEXTURE_UNIT_INVALID;
+}
+
+// returns true if the uniform already holds this value, otherwise remembers it
+b8 uniform_cached(GLData::ShaderTechnique* technique, AssetID uniform, const void* value, s32 size)
+{
+	if (size > UNIFORM_CACHE_SIZE)
+	{
+		GLData::stats.uniforms++;
+		return false;
+	}
+
+	GLData::UniformState* state = &technique->uniform_states[uniform];
+	if (state->size == size && memcmp(state->value, value, size) == 0)
+	{
+		GLData::stats.uniforms_skipped++;
+		return true;
+	}
+
+	state->size = size;
+	memcpy(state->value, value, size);
+	GLData::stats.uniforms++;
+	return false;
+}
+
 void bind_attrib_pointers(Array<GLData::Mesh::Attrib>& attribs)
 {
 	for (s32 i = 0; i < attribs.length; i++)
@@ -313,6 +392,7 @@ GLenum gl_primitive_modes[] =
 
 void render(RenderSync* sync)
 {
+	memset(&GLData::stats, 0, sizeof(GLData::stats));
 	sync->read_pos = 0;
 	while (sync->read_pos < sync->queue.length)
 	{
@@ -358,7 +438,7 @@ void render(RenderSync* sync)
 				mesh->dynamic = sync->read<b8>();
 
 				glGenVertexArrays(1, &mesh->vertex_array);
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
 				s32 attrib_count = *(sync->read<s32>());
 				for (s32 i = 0; i < attrib_count; i++)
@@ -418,7 +498,7 @@ void render(RenderSync* sync)
 				GLData::Mesh* mesh = &GLData::meshes[id];
 
 				glGenVertexArrays(1, &mesh->instance_array);
-				glBindVertexArray(mesh->instance_array);
+				bind_vertex_array(mesh->instance_array);
 
 				bind_attrib_pointers(mesh->attribs);
 
@@ -449,7 +529,7 @@ void render(RenderSync* sync)
 			{
 				AssetID id = *(sync->read<AssetID>());
 				GLData::Mesh* mesh = &GLData::meshes[id];
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
 				s32 count = *(sync->read<s32>());
 
@@ -464,7 +544,7 @@ void render(RenderSync* sync)
 			{
 				AssetID id = *(sync->read<AssetID>());
 				GLData::Mesh* mesh = &GLData::meshes[id];
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
 				s32 offset = *(sync->read<s32>());
 				s32 count = *(sync->read<s32>());
@@ -480,7 +560,7 @@ void render(RenderSync* sync)
 			{
 				AssetID id = *(sync->read<AssetID>());
 				GLData::Mesh* mesh = &GLData::meshes[id];
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
 				s32 attrib_index = *(sync->read<s32>());
 				s32 count = *(sync->read<s32>());
@@ -494,7 +574,7 @@ void render(RenderSync* sync)
 			{
 				AssetID id = *(sync->read<AssetID>());
 				GLData::Mesh* mesh = &GLData::meshes[id];
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
 				s32 attrib_index = *(sync->read<s32>());
 				s32 offset = *(sync->read<s32>());
@@ -512,7 +592,7 @@ void render(RenderSync* sync)
 				s32 index_count = *(sync->read<s32>());
 				const s32* indices = sync->read<s32>(index_count);
 
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->index_buffer);
 				glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(s32), indices, mesh->dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
 				mesh->index_count = index_count;
@@ -527,6 +607,8 @@ void render(RenderSync* sync)
 					glDeleteBuffers(1, &mesh->attribs.data[i].handle);
 				glDeleteBuffers(1, &mesh->index_buffer);
 				glDeleteBuffers(1, &mesh->instance_buffer);
+				if (GLData::current_vertex_array == mesh->instance_array || GLData::current_vertex_array == mesh->vertex_array)
+					GLData::current_vertex_array = 0; // deleting the bound vertex array unbinds it
 				glDeleteVertexArrays(1, &mesh->instance_array);
 				glDeleteVertexArrays(1, &mesh->vertex_array);
 				mesh->~Mesh();
@@ -559,6 +641,7 @@ void render(RenderSync* sync)
 					|| compare != GLData::textures[id].compare)
 				{
 					glBindTexture(type == RenderDynamicTextureType::ColorMultisample ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D, GLData::textures[id].handle);
+					GLData::texture_units[GLData::active_texture_unit] = TEXTURE_UNIT_INVALID;
 					GLData::textures[id].width = width;
 					GLData::textures[id].height = height;
 					GLData::textures[id].type = type;
@@ -627,6 +710,7 @@ void render(RenderSync* sync)
 				u32 height = *(sync->read<u32>());
 				const u8* buffer = sync->read<u8>(4 * width * height);
 				glBindTexture(GL_TEXTURE_2D, GLData::textures[id].handle);
+				GLData::texture_units[GLData::active_texture_unit] = TEXTURE_UNIT_INVALID;
 
 				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 
@@ -671,6 +755,7 @@ void render(RenderSync* sync)
 			{
 				AssetID id = *(sync->read<AssetID>());
 				glDeleteTextures(1, &GLData::textures[id].handle);
+				invalidate_texture_units(); // the handle may be reused
 				debug_check();
 				break;
 			}
@@ -692,7 +777,13 @@ void render(RenderSync* sync)
 					GLData::shaders[id][i].uniforms.resize(GLData::uniform_names.length);
 					for (s32 j = 0; j < GLData::uniform_names.length; j++)
 						GLData::shaders[id][i].uniforms[j] = glGetUniformLocation(GLData::shaders[id][i].handle, GLData::uniform_name(j));
+
+					GLData::shaders[id][i].uniform_states.resize(GLData::uniform_names.length);
+					for (s32 j = 0; j < GLData::uniform_names.length; j++)
+						GLData::shaders[id][i].uniform_states[j].size = 0;
 				}
+				if (GLData::current_shader_asset == id)
+					GLData::current_shader_asset = AssetNull; // the program changed; make sure it gets bound again
 
 				debug_check();
 				break;
@@ -702,6 +793,8 @@ void render(RenderSync* sync)
 				AssetID id = *(sync->read<AssetID>());
 				for (s32 i = 0; i < (s32)RenderTechnique::count; i++)
 					glDeleteProgram(GLData::shaders[id][i].handle);
+				if (GLData::current_shader_asset == id)
+					GLData::current_shader_asset = AssetNull;
 				debug_check();
 				break;
 			}
@@ -751,15 +844,19 @@ void render(RenderSync* sync)
 					GLData::samplers.length = 0;
 					GLuint program_id = GLData::shaders[shader_asset][(s32)technique].handle;
 					glUseProgram(program_id);
+					GLData::stats.shaders++;
 					debug_check();
 				}
+				else
+					GLData::stats.shaders_skipped++;
 				break;
 			}
 			case RenderOp::Uniform:
 			{
 				AssetID uniform_asset = *(sync->read<AssetID>());
 
-				GLuint uniform_id = GLData::shaders[GLData::current_shader_asset][(s32)GLData::current_shader_technique].uniforms[uniform_asset];
+				GLData::ShaderTechnique* technique = &GLData::shaders[GLData::current_shader_asset][(s32)GLData::current_shader_technique];
+				GLuint uniform_id = technique->uniforms[uniform_asset];
 				RenderDataType uniform_type = *(sync->read<RenderDataType>());
 				s32 uniform_count = *(sync->read<s32>());
 				switch (uniform_type)
@@ -767,6 +864,8 @@ void render(RenderSync* sync)
 					case RenderDataType::R32:
 					{
 						const r32* value = sync->read<r32>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(r32) * uniform_count))
+							break;
 						glUniform1fv(uniform_id, uniform_count, value);
 						debug_check();
 						break;
@@ -774,6 +873,8 @@ void render(RenderSync* sync)
 					case RenderDataType::Vec2:
 					{
 						const r32* value = (r32*)sync->read<Vec2>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(Vec2) * uniform_count))
+							break;
 						glUniform2fv(uniform_id, uniform_count, value);
 						debug_check();
 						break;
@@ -781,6 +882,8 @@ void render(RenderSync* sync)
 					case RenderDataType::Vec3:
 					{
 						const r32* value = (r32*)sync->read<Vec3>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(Vec3) * uniform_count))
+							break;
 						glUniform3fv(uniform_id, uniform_count, value);
 						debug_check();
 						break;
@@ -788,6 +891,8 @@ void render(RenderSync* sync)
 					case RenderDataType::Vec4:
 					{
 						const r32* value = (r32*)sync->read<Vec4>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(Vec4) * uniform_count))
+							break;
 						glUniform4fv(uniform_id, uniform_count, value);
 						debug_check();
 						break;
@@ -795,6 +900,8 @@ void render(RenderSync* sync)
 					case RenderDataType::S32:
 					{
 						const s32* value = sync->read<s32>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(s32) * uniform_count))
+							break;
 						glUniform1iv(uniform_id, uniform_count, value);
 						debug_check();
 						break;
@@ -802,6 +909,8 @@ void render(RenderSync* sync)
 					case RenderDataType::Mat4:
 					{
 						r32* value = (r32*)sync->read<Mat4>(uniform_count);
+						if (uniform_cached(technique, uniform_asset, value, sizeof(Mat4) * uniform_count))
+							break;
 						glUniformMatrix4fv(uniform_id, uniform_count, GL_FALSE, value);
 						debug_check();
 						break;
@@ -831,7 +940,6 @@ void render(RenderSync* sync)
 							sampler_index = GLData::samplers.length;
 							GLData::samplers.add(texture_asset);
 
-							glActiveTexture(GL_TEXTURE0 + sampler_index);
 							GLenum gl_texture_type;
 							switch (texture_type)
 							{
@@ -842,8 +950,9 @@ void render(RenderSync* sync)
 									vi_assert(false); // Only 2D textures supported for now
 									break;
 							}
-							glBindTexture(gl_texture_type, texture_id);
-							glUniform1i(uniform_id, sampler_index);
+							bind_texture(sampler_index, gl_texture_type, texture_id);
+							if (!uniform_cached(technique, uniform_asset, &sampler_index, sizeof(s32)))
+								glUniform1i(uniform_id, sampler_index);
 							debug_check();
 						}
 						break;
@@ -864,8 +973,9 @@ void render(RenderSync* sync)
 
 				GLData::Mesh* mesh = &GLData::meshes[id];
 
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
+				GLData::stats.draws++;
 				glDrawElements(
 					gl_primitive_modes[(s32)primitive_mode], // mode
 					mesh->index_count, // count
@@ -884,8 +994,9 @@ void render(RenderSync* sync)
 				s32 index_offset = *(sync->read<s32>());
 				s32 index_count = *(sync->read<s32>());
 
-				glBindVertexArray(mesh->vertex_array);
+				bind_vertex_array(mesh->vertex_array);
 
+				GLData::stats.draws++;
 				glDrawElements(
 					GL_TRIANGLES, // mode
 					index_count, // count
@@ -906,8 +1017,9 @@ void render(RenderSync* sync)
 				glBindBuffer(GL_ARRAY_BUFFER, mesh->instance_buffer);
 				glBufferData(GL_ARRAY_BUFFER, sizeof(Mat4) * count, sync->read<Mat4>(count), GL_DYNAMIC_DRAW);
 
-				glBindVertexArray(mesh->instance_array);
+				bind_vertex_array(mesh->instance_array);
 
+				GLData::stats.draws++;
 				glDrawElementsInstanced(
 					GL_TRIANGLES,       // mode
 					mesh->index_count,    // count
@@ -1127,6 +1239,7 @@ void render(RenderSync* sync)
 			}
 		}
 	}
+	sync->stats = GLData::stats;
 }
 
 
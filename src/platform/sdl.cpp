@@ -338,9 +338,11 @@ namespace VI
 				break;
 		}
 
+		thread_update.join();
+
+		// the update thread is the only ai producer; quit once it's gone
 		AI::quit();
 
-		thread_update.join();
 		thread_physics.join();
 		thread_ai.join();
 
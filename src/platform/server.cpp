@@ -9,9 +9,14 @@
 #include "settings.h"
 #if _WIN32
 #include <Windows.h>
+#else
+#include <unistd.h>
+#include <sys/wait.h>
 #endif
 #include <time.h>
 #include <chrono>
+#include <stdlib.h>
+#include <string.h>
 
 namespace VI
 {
@@ -28,12 +33,12 @@ namespace VI
 
 		double time()
 		{
-			return (r64)std::chrono::high_resolution_clock::now().time_since_epoch().count() / 1000000000.0;
+			return (r64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 1000000000.0;
 		}
 
 		void sleep(float time)
 		{
-			std::this_thread::sleep_for(std::chrono::milliseconds((s64)(time * 1000.0f)));
+			std::this_thread::sleep_for(std::chrono::microseconds((s64)(time * 1000000.0f)));
 		}
 
 	}
@@ -42,10 +47,11 @@ namespace VI
 	{
 		// Launch threads
 
+		// there is no render thread on the server.
+		// the update loop runs on the main thread and paces itself at the network tick rate.
 		Sync<LoopSync> render_sync;
 
 		LoopSwapper update_swapper = render_sync.swapper(0);
-		LoopSwapper render_swapper = render_sync.swapper(1);
 
 		Sync<PhysicsSync, 1> physics_sync;
 
@@ -54,41 +60,153 @@ namespace VI
 
 		std::thread physics_thread(Physics::loop, &physics_swapper);
 
-		std::thread update_thread(Loop::loop, &update_swapper, &physics_update_swapper);
-
 		std::thread ai_thread(AI::loop);
 
-		LoopSync* sync = render_swapper.get();
+		Loop::loop(&update_swapper, &physics_update_swapper);
 
-		r64 last_time = platform::time();
+		AI::quit();
 
-		while (true)
-		{
-			r64 time = platform::time();
-			sync->time.total = (r32)time;
-			sync->time.delta = vi_min((r32)(time - last_time), 0.25f);
-			last_time = time;
+		physics_thread.join();
+		ai_thread.join();
 
-			b8 quit = sync->quit;
+		return 0;
+	}
 
-			sync = render_swapper.swap<SwapType_Read>();
+#if !_WIN32
+#define RESTART_DELAY_MIN 1.0f
+#define RESTART_DELAY_MAX 60.0f
+#define RESTART_STABLE_TIME 300.0f // an instance that ran this long before crashing starts over at the minimum delay
 
-			if (quit || sync->quit)
-				break;
+	struct Instance
+	{
+		pid_t pid;
+		r64 start_time;
+		r64 restart_time; // when to restart a crashed instance; 0 if it's running or finished
+		r32 restart_delay;
+	};
+
+	// every subsystem keeps its state in process-wide statics, so each match runs in its own process.
+	// level meshes are loaded once here, before forking, so the instances share them copy-on-write.
+	// everything a match mutates (entities, physics world, nav mesh tile cache) is still per instance.
+	// instance i listens on the base port + i. crashed instances are restarted with exponential backoff.
+	s32 supervise(s32 instances)
+	{
+		{
+			Sync<LoopSync> preload_sync;
+			LoopSwapper preload_swapper = preload_sync.swapper(0);
+			Loader::init(&preload_swapper);
+			Loader::level_meshes_permanent(Net::Server::level);
 		}
 
-		AI::quit();
+		u16 base_port = Net::Server::port;
+		Array<Instance> children(instances, instances);
 
-		update_thread.join();
-		physics_thread.join();
-		ai_thread.join();
+		for (s32 i = 0; i < instances; i++)
+		{
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				Net::Server::port = u16(base_port + i);
+				return proc();
+			}
+			else if (pid < 0)
+			{
+				fprintf(stderr, "Failed to fork instance %d.\n", i);
+				return 1;
+			}
+			children[i].pid = pid;
+			children[i].start_time = platform::time();
+			children[i].restart_time = 0.0;
+			children[i].restart_delay = RESTART_DELAY_MIN;
+		}
+
+		while (true)
+		{
+			r64 now = platform::time();
+
+			s32 status;
+			pid_t pid;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+			{
+				for (s32 i = 0; i < children.length; i++)
+				{
+					Instance* child = &children[i];
+					if (child->pid == pid)
+					{
+						child->pid = 0;
+						if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+						{
+							if (now - child->start_time > RESTART_STABLE_TIME)
+								child->restart_delay = RESTART_DELAY_MIN;
+							fprintf(stderr, "Instance %d exited abnormally; restarting in %.0f seconds.\n", i, child->restart_delay);
+							child->restart_time = now + child->restart_delay;
+							child->restart_delay = vi_min(child->restart_delay * 2.0f, RESTART_DELAY_MAX);
+						}
+						break;
+					}
+				}
+			}
+
+			b8 active = false;
+			for (s32 i = 0; i < children.length; i++)
+			{
+				Instance* child = &children[i];
+				if (child->restart_time > 0.0 && now >= child->restart_time)
+				{
+					pid_t restarted = fork();
+					if (restarted == 0)
+					{
+						Net::Server::port = u16(base_port + i);
+						return proc();
+					}
+					else if (restarted > 0)
+					{
+						child->pid = restarted;
+						child->start_time = now;
+						child->restart_time = 0.0;
+					}
+					else
+						child->restart_time = now + child->restart_delay; // try again later
+				}
+				if (child->pid || child->restart_time > 0.0)
+					active = true;
+			}
+
+			if (!active)
+				break; // every instance exited cleanly
+
+			platform::sleep(0.1f);
+		}
 
 		return 0;
 	}
+#endif
 
 }
 
 int main(int argc, char** argv)
 {
+	VI::s32 instances = 1;
+	for (VI::s32 i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--instances") == 0)
+			instances = VI::vi_max(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--port") == 0)
+			VI::Net::Server::port = (VI::u16)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--clients") == 0)
+			VI::Net::Server::expected_clients = VI::vi_max(1, VI::vi_min(MAX_PLAYERS, atoi(argv[i + 1]))); // every client needs a PlayerManager
+		else if (strcmp(argv[i], "--capture") == 0)
+			VI::Net::capture_path = argv[i + 1];
+		else if (strcmp(argv[i], "--replay") == 0)
+			VI::Net::replay_path = argv[i + 1];
+	}
+
+#if _WIN32
 	return VI::proc();
+#else
+	if (instances > 1)
+		return VI::supervise(instances);
+	else
+		return VI::proc();
+#endif
 }
@@ -1,3 +1,6 @@
+#ifdef __linux__
+#define _GNU_SOURCE 1 // sendmmsg/recvmmsg
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -12,6 +15,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 namespace VI
@@ -195,6 +199,144 @@ s32 udp_receive(Handle* socket, Address* sender, void* data, s32 size)
 	return received_bytes;
 }
 
+#ifdef __linux__
+
+s32 udp_send_batch(Handle* socket, const Datagram* datagrams, s32 count)
+{
+	if (!socket)
+		return error("Socket is NULL");
+
+	struct sockaddr_in addresses[SOCK_BATCH];
+	struct iovec iovecs[SOCK_BATCH];
+	struct mmsghdr messages[SOCK_BATCH];
+
+	// a failed datagram (full buffer, unreachable peer) is skipped so it doesn't take the rest of the batch with it
+	s32 sent = 0;
+	s32 delivered = 0;
+	while (sent < count)
+	{
+		s32 batch = count - sent;
+		if (batch > SOCK_BATCH)
+			batch = SOCK_BATCH;
+
+		memset(messages, 0, sizeof(struct mmsghdr) * batch);
+		for (s32 i = 0; i < batch; i++)
+		{
+			const Datagram* datagram = &datagrams[sent + i];
+			addresses[i].sin_family = AF_INET;
+			addresses[i].sin_addr.s_addr = datagram->address.host;
+			addresses[i].sin_port = htons(datagram->address.port);
+			iovecs[i].iov_base = (void*)datagram->data;
+			iovecs[i].iov_len = datagram->size;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			messages[i].msg_hdr.msg_iov = &iovecs[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		s32 result = sendmmsg(socket->handle, messages, batch, 0);
+		if (result <= 0)
+		{
+			error("Failed to send data");
+			sent++;
+		}
+		else
+		{
+			sent += result;
+			delivered += result;
+		}
+	}
+
+	return delivered;
+}
+
+s32 udp_receive_batch(Handle* socket, Datagram* datagrams, s32 count)
+{
+	if (!socket)
+		return error("Socket is NULL");
+
+	if (count > SOCK_BATCH)
+		count = SOCK_BATCH;
+
+	struct sockaddr_in addresses[SOCK_BATCH];
+	struct iovec iovecs[SOCK_BATCH];
+	struct mmsghdr messages[SOCK_BATCH];
+	memset(messages, 0, sizeof(struct mmsghdr) * count);
+	for (s32 i = 0; i < count; i++)
+	{
+		iovecs[i].iov_base = datagrams[i].data;
+		iovecs[i].iov_len = SOCK_MAX_DATAGRAM;
+		messages[i].msg_hdr.msg_name = &addresses[i];
+		messages[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	s32 received = recvmmsg(socket->handle, messages, count, MSG_DONTWAIT, nullptr);
+	if (received <= 0)
+		return 0;
+
+	for (s32 i = 0; i < received; i++)
+	{
+		datagrams[i].address.host = addresses[i].sin_addr.s_addr;
+		datagrams[i].address.port = ntohs(addresses[i].sin_port);
+		datagrams[i].size = messages[i].msg_len;
+	}
+
+	return received;
+}
+
+#else
+
+s32 udp_send_batch(Handle* socket, const Datagram* datagrams, s32 count)
+{
+	s32 delivered = 0;
+	for (s32 i = 0; i < count; i++)
+	{
+		if (udp_send(socket, datagrams[i].address, datagrams[i].data, datagrams[i].size) == 0)
+			delivered++;
+	}
+	return delivered;
+}
+
+s32 udp_receive_batch(Handle* socket, Datagram* datagrams, s32 count)
+{
+	s32 received = 0;
+	while (received < count)
+	{
+		Datagram* datagram = &datagrams[received];
+		datagram->size = udp_receive(socket, &datagram->address, datagram->data, SOCK_MAX_DATAGRAM);
+		if (datagram->size <= 0)
+			break;
+		received++;
+	}
+	return received;
+}
+
+#endif
+
+s32 udp_wait(Handle* socket, r32 timeout)
+{
+	if (!socket)
+		return error("Socket is NULL");
+
+#ifdef _WIN32
+	fd_set read_set;
+	FD_ZERO(&read_set);
+	FD_SET(socket->handle, &read_set);
+	struct timeval tv;
+	tv.tv_sec = long(timeout);
+	tv.tv_usec = long((timeout - r32(tv.tv_sec)) * 1000000.0f);
+	return select(0, &read_set, nullptr, nullptr, &tv);
+#else
+	struct pollfd fd;
+	fd.fd = socket->handle;
+	fd.events = POLLIN;
+	fd.revents = 0;
+	return poll(&fd, 1, s32(timeout * 1000.0f));
+#endif
+}
+
 
 }
 
@@ -22,6 +22,16 @@ struct Handle
 	s32 ready;
 };
 
+#define SOCK_MAX_DATAGRAM 1500
+#define SOCK_BATCH 32 // max datagrams moved per batched syscall
+
+struct Datagram
+{
+	Address address;
+	s32 size;
+	u8 data[SOCK_MAX_DATAGRAM];
+};
+
 const char* get_error(void);
 s32 init(void);
 void netshutdown(void);
@@ -34,6 +44,12 @@ int udp_open(Handle* socket, u32 port, u32 non_blocking);
 int udp_send(Handle* socket, Address destination, const void* data, s32 size);
 int udp_receive(Handle* socket, Address* sender, void* data, s32 size);
 
+// batched versions; one syscall per batch on Linux (sendmmsg/recvmmsg)
+// udp_send_batch skips datagrams which fail to send and returns how many went out
+s32 udp_send_batch(Handle* socket, const Datagram* datagrams, s32 count);
+s32 udp_receive_batch(Handle* socket, Datagram* datagrams, s32 count);
+s32 udp_wait(Handle* socket, r32 timeout); // block until the socket is readable or the timeout expires
+
 
 }
 
@@ -0,0 +1,67 @@
+#define _AMD64_
+
+#include "types.h"
+#include "lmath.h"
+#include "net.h"
+#include <thread>
+#include <chrono>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+
+// headless load tester. spawns a swarm of virtual clients against a running server:
+// yearningswarm --host 127.0.0.1 --port 3494 --clients 4 --ramp 4 --duration 60
+// start the server with the same --clients count so it waits for all of them.
+// each server instance takes at most MAX_PLAYERS clients (see game/team.h). to go beyond that,
+// start the server with --instances and run one swarm per instance port (base port + i).
+
+namespace VI
+{
+
+	namespace platform
+	{
+
+		u64 timestamp()
+		{
+			time_t t;
+			::time(&t);
+			return (u64)t;
+		}
+
+		double time()
+		{
+			return (r64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() / 1000000000.0;
+		}
+
+		void sleep(float time)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds((s64)(time * 1000000.0f)));
+		}
+
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const char* host = "127.0.0.1";
+	VI::u16 port = NET_SERVER_PORT;
+	VI::s32 clients = 1;
+	VI::r32 ramp = 10.0f; // clients spawned per second
+	VI::r32 duration = 60.0f;
+	for (VI::s32 i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--host") == 0)
+			host = argv[i + 1];
+		else if (strcmp(argv[i], "--port") == 0)
+			port = (VI::u16)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--clients") == 0)
+			clients = VI::vi_max(1, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "--ramp") == 0)
+			ramp = VI::vi_max(0.1f, (VI::r32)atof(argv[i + 1]));
+		else if (strcmp(argv[i], "--duration") == 0)
+			duration = (VI::r32)atof(argv[i + 1]);
+	}
+
+	return VI::Net::Swarm::run(host, port, clients, ramp, duration);
+}
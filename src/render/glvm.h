@@ -116,8 +116,23 @@ enum class RenderFillMode
 typedef u8 RenderColorMask;
 #define RENDER_COLOR_MASK_DEFAULT 31
 
+// GL calls made and skipped by the last call to render()
+struct RenderStats
+{
+	s32 draws;
+	s32 shaders;
+	s32 shaders_skipped;
+	s32 uniforms;
+	s32 uniforms_skipped;
+	s32 textures;
+	s32 textures_skipped;
+	s32 vertex_arrays;
+	s32 vertex_arrays_skipped;
+};
+
 struct RenderSync : public SyncBuffer
 {
+	RenderStats stats;
 };
 
 enum class RenderTextureType
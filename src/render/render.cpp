@@ -1,4 +1,5 @@
 #include "render.h"
+#include <algorithm>
 
 namespace VI
 {
@@ -39,6 +40,7 @@ Camera::ViewportBlueprint* Camera::viewport_blueprints[] =
 };
 
 Camera Camera::list[Camera::max_cameras];
+Array<RenderQueue::Entry> RenderQueue::entries;
 
 Camera::Camera()
 	: active(),
@@ -163,4 +165,255 @@ void Camera::update_frustum()
 	frustum_rays[3] = rays[7].xyz() / rays[7].z;
 }
 
+#define CULL_TREE_LEAF_SIZE 16
+
+CullTree::Frustum::Frustum(const Camera* camera)
+	: pos(camera->pos),
+	forward(camera->rot * Vec3(0, 0, 1)),
+	near_plane(camera->near_plane),
+	far_plane(camera->far_plane)
+{
+	for (s32 i = 0; i < 4; i++)
+	{
+		Vec3 normal = camera->rot * camera->frustum[i].normal;
+		planes[i] = Plane(normal, camera->frustum[i].d - normal.dot(camera->pos));
+	}
+}
+
+// same test as Camera::visible_sphere, in world space
+b8 CullTree::Frustum::visible(const Vec3& center, r32 radius) const
+{
+	Vec3 diff = center - pos;
+	r32 z = forward.dot(diff);
+	if (z + radius <= near_plane || z - radius >= far_plane)
+		return false;
+	if (diff.length_squared() < radius * radius)
+		return true;
+	for (s32 i = 0; i < 4; i++)
+	{
+		if (planes[i].distance(center) < -radius)
+			return false;
+	}
+	return true;
+}
+
+// true if every sphere inside this one is visible
+b8 CullTree::Frustum::contains(const Vec3& center, r32 radius) const
+{
+	r32 z = forward.dot(center - pos);
+	if (z - radius <= near_plane || z + radius >= far_plane)
+		return false;
+	for (s32 i = 0; i < 4; i++)
+	{
+		if (planes[i].distance(center) < radius)
+			return false;
+	}
+	return true;
+}
+
+void CullTree::clear()
+{
+	centers.length = 0;
+	radii.length = 0;
+	ids.length = 0;
+	nodes.length = 0;
+	query_valid = false;
+}
+
+void CullTree::add(ID id, const Vec3& center, r32 radius)
+{
+	centers.add(center);
+	radii.add(radius);
+	ids.add(id);
+}
+
+// builds the subtree over order[start, start + count) and returns its node index
+s32 cull_tree_build(CullTree* tree, s32 start, s32 count)
+{
+	Vec3 bounds_min(FLT_MAX);
+	Vec3 bounds_max(-FLT_MAX);
+	Vec3 centers_min(FLT_MAX);
+	Vec3 centers_max(-FLT_MAX);
+	for (s32 i = start; i < start + count; i++)
+	{
+		const Vec3& center = tree->centers[tree->order[i]];
+		r32 radius = tree->radii[tree->order[i]];
+		for (s32 axis = 0; axis < 3; axis++)
+		{
+			bounds_min[axis] = vi_min(bounds_min[axis], center[axis] - radius);
+			bounds_max[axis] = vi_max(bounds_max[axis], center[axis] + radius);
+			centers_min[axis] = vi_min(centers_min[axis], center[axis]);
+			centers_max[axis] = vi_max(centers_max[axis], center[axis]);
+		}
+	}
+
+	s32 index = tree->nodes.length;
+	{
+		CullTree::Node* node = tree->nodes.add();
+		node->center = (bounds_min + bounds_max) * 0.5f;
+		node->radius = 0.0f;
+		for (s32 i = start; i < start + count; i++)
+			node->radius = vi_max(node->radius, (tree->centers[tree->order[i]] - node->center).length() + tree->radii[tree->order[i]]);
+		node->start = start;
+		node->count = count;
+		node->left = -1;
+		node->right = -1;
+	}
+
+	if (count > CULL_TREE_LEAF_SIZE)
+	{
+		// split at the median along the axis where the centers are most spread out
+		Vec3 extent = centers_max - centers_min;
+		s32 axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		s32 half = count / 2;
+		const Array<Vec3>& centers = tree->centers;
+		std::nth_element
+		(
+			&tree->order[start],
+			&tree->order[start + half],
+			&tree->order[start] + count,
+			[&centers, axis](s32 a, s32 b) { return centers[a][axis] < centers[b][axis]; }
+		);
+		s32 left = cull_tree_build(tree, start, half);
+		s32 right = cull_tree_build(tree, start + half, count - half);
+		tree->nodes[index].left = left;
+		tree->nodes[index].right = right;
+	}
+
+	return index;
+}
+
+void CullTree::build()
+{
+	query_valid = false;
+	nodes.length = 0;
+	if (ids.length == 0)
+		return;
+
+	order.resize(ids.length);
+	for (s32 i = 0; i < order.length; i++)
+		order[i] = i;
+
+	cull_tree_build(this, 0, order.length);
+
+	// store the items in leaf order so each leaf is contiguous
+	static Array<Vec3> sorted_centers;
+	static Array<r32> sorted_radii;
+	static Array<ID> sorted_ids;
+	sorted_centers.resize(order.length);
+	sorted_radii.resize(order.length);
+	sorted_ids.resize(order.length);
+	for (s32 i = 0; i < order.length; i++)
+	{
+		sorted_centers[i] = centers[order[i]];
+		sorted_radii[i] = radii[order[i]];
+		sorted_ids[i] = ids[order[i]];
+	}
+	memcpy(centers.data, sorted_centers.data, sizeof(Vec3) * order.length);
+	memcpy(radii.data, sorted_radii.data, sizeof(r32) * order.length);
+	memcpy(ids.data, sorted_ids.data, sizeof(ID) * order.length);
+}
+
+const Bitmask<MAX_ENTITIES>& CullTree::query(const Camera* camera)
+{
+	if (query_valid && memcmp(&query_camera, camera, sizeof(Camera)) == 0)
+		return visible;
+
+	memcpy(&query_camera, camera, sizeof(Camera));
+	query_valid = true;
+	visible.clear();
+
+	if (nodes.length == 0)
+		return visible;
+
+	Frustum frustum(camera);
+
+	StaticArray<s32, 64> stack;
+	stack.add(0);
+	while (stack.length > 0)
+	{
+		stack.length--;
+		const Node& node = nodes[stack.data[stack.length]];
+		if (!frustum.visible(node.center, node.radius))
+			continue;
+
+		if (frustum.contains(node.center, node.radius))
+		{
+			for (s32 i = node.start; i < node.start + node.count; i++)
+				visible.set(ids[i], true);
+		}
+		else if (node.left == -1)
+		{
+			for (s32 i = node.start; i < node.start + node.count; i++)
+			{
+				if (frustum.visible(centers[i], radii[i]))
+					visible.set(ids[i], true);
+			}
+		}
+		else
+		{
+			stack.add(node.left);
+			stack.add(node.right);
+		}
+	}
+
+	return visible;
+}
+
+#define RENDER_KEY_DEPTH_BITS 24
+#define RENDER_KEY_DEPTH_MASK ((u64(1) << RENDER_KEY_DEPTH_BITS) - 1)
+
+// distance from the camera, quantized to RENDER_KEY_DEPTH_BITS
+u64 render_key_depth(const RenderParams& params, const Vec3& pos)
+{
+	if (params.camera->far_plane <= 0.0f)
+		return 0;
+	r32 depth = (pos - params.camera->pos).length() / params.camera->far_plane;
+	if (depth < 0.0f)
+		depth = 0.0f;
+	else if (depth > 1.0f)
+		depth = 1.0f;
+	return u64(depth * r32(RENDER_KEY_DEPTH_MASK));
+}
+
+// AssetNull becomes zero
+u64 render_key_asset(AssetID id, s32 bits)
+{
+	return u64(AssetID(id + 1)) & ((u64(1) << bits) - 1);
+}
+
+// shader:12 texture:12 mesh:16 depth:24
+u64 RenderQueue::key_opaque(const RenderParams& params, AssetID shader, AssetID texture, AssetID mesh, const Vec3& pos)
+{
+	return (render_key_asset(shader, 12) << 52)
+		| (render_key_asset(texture, 12) << 40)
+		| (render_key_asset(mesh, 16) << 24)
+		| render_key_depth(params, pos);
+}
+
+// inverse depth:24 shader:12 texture:12 mesh:16
+u64 RenderQueue::key_alpha(const RenderParams& params, AssetID shader, AssetID texture, AssetID mesh, const Vec3& pos)
+{
+	return ((RENDER_KEY_DEPTH_MASK - render_key_depth(params, pos)) << 40)
+		| (render_key_asset(shader, 12) << 28)
+		| (render_key_asset(texture, 12) << 16)
+		| render_key_asset(mesh, 16);
+}
+
+void RenderQueue::add(u64 key, DrawFunction function, ID id)
+{
+	Entry* entry = entries.add();
+	entry->key = key;
+	entry->function = function;
+	entry->id = id;
+}
+
+void RenderQueue::flush(const RenderParams& params)
+{
+	std::sort(entries.data, entries.data + entries.length, [](const Entry& a, const Entry& b) { return a.key < b.key; });
+	for (s32 i = 0; i < entries.length; i++)
+		(*entries[i].function)(params, entries[i].id);
+	entries.length = 0;
+}
+
 }
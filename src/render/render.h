@@ -5,6 +5,7 @@
 #include "sync.h"
 #include "input.h"
 #include "glvm.h"
+#include "data/pin_array.h"
 
 namespace VI
 {
@@ -119,4 +120,72 @@ struct RenderParams
 	}
 };
 
+// bounding sphere hierarchy over renderables, rebuilt once per frame.
+// a query tests whole subtrees against a camera and produces the set of IDs that might be visible.
+struct CullTree
+{
+	struct Node
+	{
+		Vec3 center;
+		r32 radius;
+		s32 start;
+		s32 count;
+		s32 left; // -1 for leaves
+		s32 right;
+	};
+
+	// camera frustum in world space
+	struct Frustum
+	{
+		Plane planes[4];
+		Vec3 pos;
+		Vec3 forward;
+		r32 near_plane;
+		r32 far_plane;
+
+		Frustum(const Camera*);
+		b8 visible(const Vec3&, r32) const;
+		b8 contains(const Vec3&, r32) const;
+	};
+
+	// items, stored SoA and sorted into leaf order by build()
+	Array<Vec3> centers;
+	Array<r32> radii;
+	Array<ID> ids;
+	Array<s32> order;
+	Array<Node> nodes;
+
+	// the last query, reused until the camera or the tree changes
+	Camera query_camera;
+	b8 query_valid;
+	Bitmask<MAX_ENTITIES> visible;
+
+	void clear();
+	void add(ID, const Vec3&, r32);
+	void build();
+	const Bitmask<MAX_ENTITIES>& query(const Camera*);
+};
+
+// collects the draws of a single pass, then issues them sorted by a 64-bit key
+// opaque keys sort by shader, texture and mesh to minimize state changes, then front-to-back
+// alpha keys sort back-to-front first, then by state
+struct RenderQueue
+{
+	typedef void(*DrawFunction)(const RenderParams&, ID);
+
+	struct Entry
+	{
+		u64 key;
+		DrawFunction function;
+		ID id;
+	};
+
+	static Array<Entry> entries;
+
+	static u64 key_opaque(const RenderParams&, AssetID, AssetID, AssetID, const Vec3&);
+	static u64 key_alpha(const RenderParams&, AssetID, AssetID, AssetID, const Vec3&);
+	static void add(u64, DrawFunction, ID);
+	static void flush(const RenderParams&);
+};
+
 }
@@ -17,6 +17,7 @@ namespace VI
 Bitmask<MAX_ENTITIES> SkinnedModel::list_alpha;
 Bitmask<MAX_ENTITIES> SkinnedModel::list_additive;
 Bitmask<MAX_ENTITIES> SkinnedModel::list_alpha_depth;
+CullTree SkinnedModel::cull_tree;
 
 SkinnedModel::SkinnedModel()
 	: mesh(),
@@ -52,40 +53,92 @@ SkinnedModel::~SkinnedModel()
 	alpha_disable();
 }
 
+// returns the bounding sphere radius
+r32 skinned_model_bounds(const SkinnedModel* model, const Mesh* mesh_data, Mat4* m)
+{
+	model->get<Transform>()->mat(m);
+	*m = model->offset * *m;
+	Vec3 radius = (model->offset * Vec4(mesh_data->bounds_radius, mesh_data->bounds_radius, mesh_data->bounds_radius, 0)).xyz();
+	return vi_max(radius.x, vi_max(radius.y, radius.z));
+}
+
+// call once per frame before drawing, after everything has moved
+void SkinnedModel::cull_build()
+{
+	cull_tree.clear();
+	for (auto i = list.iterator(); !i.is_last(); i.next())
+	{
+		const Mesh* mesh_data = Loader::mesh(i.item()->mesh);
+		if (!mesh_data)
+			continue;
+		Mat4 m;
+		r32 radius = skinned_model_bounds(i.item(), mesh_data, &m);
+		cull_tree.add(i.index, m.translation(), radius);
+	}
+	cull_tree.build();
+}
+
+void skinned_model_draw(const RenderParams& params, ID id)
+{
+	SkinnedModel::list[id].draw(params);
+}
+
+void skinned_model_queue(SkinnedModel* m, const RenderParams& params, b8 back_to_front)
+{
+	if (!(params.camera->mask & m->mask))
+		return;
+
+	Vec3 pos = m->get<Transform>()->absolute_pos();
+	u64 key;
+	if (back_to_front)
+		key = RenderQueue::key_alpha(params, m->shader, m->texture, m->mesh, pos);
+	else
+		key = RenderQueue::key_opaque(params, m->shader, m->texture, m->mesh, pos);
+	RenderQueue::add(key, &skinned_model_draw, m->id());
+}
+
 void SkinnedModel::draw_opaque(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = SkinnedModel::list.iterator(); !i.is_last(); i.next())
 	{
-		if (!list_alpha.get(i.index) && !list_additive.get(i.index) && !list_alpha_depth.get(i.index))
-			i.item()->draw(params);
+		if (visible.get(i.index) && !list_alpha.get(i.index) && !list_additive.get(i.index) && !list_alpha_depth.get(i.index))
+			skinned_model_queue(i.item(), params, false);
 	}
+	RenderQueue::flush(params);
 }
 
 void SkinnedModel::draw_additive(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = SkinnedModel::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_additive.get(i.index))
-			i.item()->draw(params);
+		if (list_additive.get(i.index) && visible.get(i.index))
+			skinned_model_queue(i.item(), params, false);
 	}
+	RenderQueue::flush(params);
 }
 
 void SkinnedModel::draw_alpha(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = SkinnedModel::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_alpha.get(i.index))
-			i.item()->draw(params);
+		if (list_alpha.get(i.index) && visible.get(i.index))
+			skinned_model_queue(i.item(), params, true);
 	}
+	RenderQueue::flush(params);
 }
 
 void SkinnedModel::draw_alpha_depth(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = SkinnedModel::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_alpha_depth.get(i.index))
-			i.item()->draw(params);
+		if (list_alpha_depth.get(i.index) && visible.get(i.index))
+			skinned_model_queue(i.item(), params, true);
 	}
+	RenderQueue::flush(params);
 }
 
 void SkinnedModel::alpha()
@@ -168,16 +221,9 @@ void SkinnedModel::draw(const RenderParams& params)
 	RenderSync* sync = params.sync;
 
 	Mat4 m;
-	get<Transform>()->mat(&m);
-	
-	m = offset * m;
-
-	const Mesh* mesh_data = Loader::mesh(mesh);
-	{
-		Vec3 radius = (offset * Vec4(mesh_data->bounds_radius, mesh_data->bounds_radius, mesh_data->bounds_radius, 0)).xyz();
-		if (!params.camera->visible_sphere(m.translation(), vi_max(radius.x, vi_max(radius.y, radius.z))))
-			return;
-	}
+	r32 radius = skinned_model_bounds(this, Loader::mesh(mesh), &m);
+	if (!params.camera->visible_sphere(m.translation(), radius))
+		return;
 
 	sync->write(RenderOp::Shader);
 	sync->write(shader);
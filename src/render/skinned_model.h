@@ -12,11 +12,13 @@ struct SkinnedModel : public ComponentType<SkinnedModel>
 	static Bitmask<MAX_ENTITIES> list_alpha;
 	static Bitmask<MAX_ENTITIES> list_additive;
 	static Bitmask<MAX_ENTITIES> list_alpha_depth;
+	static CullTree cull_tree;
 
 	static void draw_opaque(const RenderParams&);
 	static void draw_alpha(const RenderParams&);
 	static void draw_alpha_depth(const RenderParams&);
 	static void draw_additive(const RenderParams&);
+	static void cull_build();
 
 	StaticArray<Mat4, MAX_BONES> skin_transforms;
 	Mat4 offset;
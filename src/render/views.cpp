@@ -14,6 +14,27 @@ namespace VI
 Bitmask<MAX_ENTITIES> View::list_alpha;
 Bitmask<MAX_ENTITIES> View::list_additive;
 Bitmask<MAX_ENTITIES> View::list_alpha_depth;
+CullTree View::cull_tree;
+
+#define MAX_VIEW_BATCHES 128
+
+struct ViewBatch
+{
+	AssetID mesh;
+	Vec4 color;
+	s32 count;
+	s32 offset;
+};
+
+struct ViewInstance
+{
+	Mat4 m;
+	s32 batch;
+};
+
+StaticArray<ViewBatch, MAX_VIEW_BATCHES> view_batches;
+Array<ViewInstance> view_instances;
+Array<Mat4> view_instance_matrices;
 
 View::View(AssetID m)
 	: mesh(m),
@@ -31,40 +52,229 @@ View::~View()
 	alpha_disable();
 }
 
+Vec4 view_color(const View* v, const RenderParams& params)
+{
+	if (v->team == (u8)AI::TeamNone)
+		return v->color;
+	else
+	{
+		const Vec4& team_color = Team::color((AI::Team)v->team, (AI::Team)params.camera->team);
+		if (View::list_alpha.get(v->id()) || View::list_additive.get(v->id()) || View::list_alpha_depth.get(v->id()))
+			return Vec4(team_color.xyz(), v->color.w);
+		else
+			return team_color;
+	}
+}
+
+// returns the bounding sphere radius
+r32 view_bounds(const View* v, const Mesh* mesh_data, Mat4* m)
+{
+	v->get<Transform>()->mat(m);
+	*m = v->offset * *m;
+	Vec3 radius = (v->offset * Vec4(mesh_data->bounds_radius, mesh_data->bounds_radius, mesh_data->bounds_radius, 0)).xyz();
+	return vi_max(radius.x, vi_max(radius.y, radius.z));
+}
+
+b8 view_visible(const View* v, const Mesh* mesh_data, const RenderParams& params, Mat4* m)
+{
+	r32 radius = view_bounds(v, mesh_data, m);
+	return params.camera->visible_sphere(m->translation(), radius);
+}
+
+// call once per frame before drawing, after everything has moved
+void View::cull_build()
+{
+	cull_tree.clear();
+	for (auto i = list.iterator(); !i.is_last(); i.next())
+	{
+		const Mesh* mesh_data = Loader::mesh(i.item()->mesh);
+		if (!mesh_data)
+			continue;
+		Mat4 m;
+		r32 radius = view_bounds(i.item(), mesh_data, &m);
+		cull_tree.add(i.index, m.translation(), radius);
+	}
+	cull_tree.build();
+}
+
+// if allow_culled_shader is false, replace the culled shader with the standard shader.
+AssetID view_shader(const View* v, const RenderParams& params)
+{
+	b8 allow_culled_shader = params.camera->cull_range > 0.0f;
+	return allow_culled_shader || v->shader != Asset::Shader::culled ? v->shader : Asset::Shader::standard;
+}
+
+void view_draw(const RenderParams& params, ID id)
+{
+	View::list[id].draw(params);
+}
+
+void view_queue(const View* v, const RenderParams& params, b8 back_to_front)
+{
+	AssetID shader = view_shader(v, params);
+	Vec3 pos = v->get<Transform>()->absolute_pos();
+	u64 key;
+	if (back_to_front)
+		key = RenderQueue::key_alpha(params, shader, v->texture, v->mesh, pos);
+	else
+		key = RenderQueue::key_opaque(params, shader, v->texture, v->mesh, pos);
+	RenderQueue::add(key, &view_draw, v->id());
+}
+
+// untextured views using the standard shader can be drawn with standard_instanced,
+// as long as the mesh has no extra attributes in the way of the instance matrix
+b8 View::instanceable(const RenderParams& params) const
+{
+	if (mesh == AssetNull || texture != AssetNull || view_shader(this, params) != Asset::Shader::standard)
+		return false;
+	const Mesh* mesh_data = Loader::mesh(mesh);
+	return mesh_data->attrib_count == 2;
+}
+
+// opaque views sharing a mesh and color are drawn with a single instanced draw call
 void View::draw_opaque(const RenderParams& params)
 {
+	view_batches.length = 0;
+	view_instances.length = 0;
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = View::list.iterator(); !i.is_last(); i.next())
 	{
-		if (!list_alpha.get(i.index) && !list_additive.get(i.index) && !list_alpha_depth.get(i.index) && (i.item()->mask & params.camera->mask))
-			i.item()->draw(params);
+		View* v = i.item();
+		if (!visible.get(i.index) || list_alpha.get(i.index) || list_additive.get(i.index) || list_alpha_depth.get(i.index) || !(v->mask & params.camera->mask))
+			continue;
+
+		if (!v->instanceable(params))
+		{
+			view_queue(v, params, false);
+			continue;
+		}
+
+		Mat4 m;
+		if (!view_visible(v, Loader::mesh(v->mesh), params, &m))
+			continue;
+
+		Vec4 color = view_color(v, params);
+		s32 batch_index = -1;
+		for (s32 j = 0; j < view_batches.length; j++)
+		{
+			const ViewBatch& batch = view_batches[j];
+			if (batch.mesh == v->mesh && batch.color == color)
+			{
+				batch_index = j;
+				break;
+			}
+		}
+		if (batch_index == -1)
+		{
+			if (view_batches.length == view_batches.capacity())
+			{
+				view_queue(v, params, false); // out of batches; draw it the slow way
+				continue;
+			}
+			batch_index = view_batches.length;
+			ViewBatch* batch = view_batches.add();
+			batch->mesh = v->mesh;
+			batch->color = color;
+			batch->count = 0;
+		}
+		view_batches[batch_index].count++;
+		ViewInstance* instance = view_instances.add();
+		instance->m = m;
+		instance->batch = batch_index;
+	}
+
+	RenderQueue::flush(params);
+
+	if (view_instances.length == 0)
+		return;
+
+	// sort instance matrices into contiguous runs, one per batch
+	{
+		s32 offset = 0;
+		for (s32 i = 0; i < view_batches.length; i++)
+		{
+			view_batches[i].offset = offset;
+			offset += view_batches[i].count;
+			view_batches[i].count = 0;
+		}
+		view_instance_matrices.resize(view_instances.length);
+		for (s32 i = 0; i < view_instances.length; i++)
+		{
+			const ViewInstance& instance = view_instances[i];
+			ViewBatch* batch = &view_batches[instance.batch];
+			view_instance_matrices[batch->offset + batch->count] = instance.m;
+			batch->count++;
+		}
+	}
+
+	Loader::shader_permanent(Asset::Shader::standard_instanced);
+
+	RenderSync* sync = params.sync;
+	sync->write(RenderOp::Shader);
+	sync->write(Asset::Shader::standard_instanced);
+	sync->write(params.technique);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::vp);
+	sync->write(RenderDataType::Mat4);
+	sync->write<s32>(1);
+	sync->write<Mat4>(params.view_projection);
+
+	sync->write(RenderOp::Uniform);
+	sync->write(Asset::Uniform::v);
+	sync->write(RenderDataType::Mat4);
+	sync->write<s32>(1);
+	sync->write<Mat4>(params.view);
+
+	for (s32 i = 0; i < view_batches.length; i++)
+	{
+		const ViewBatch& batch = view_batches[i];
+		Loader::mesh_instanced(batch.mesh);
+
+		sync->write(RenderOp::Uniform);
+		sync->write(Asset::Uniform::diffuse_color);
+		sync->write(RenderDataType::Vec4);
+		sync->write<s32>(1);
+		sync->write<Vec4>(batch.color);
+
+		sync->write(RenderOp::Instances);
+		sync->write(batch.mesh);
+		sync->write(batch.count);
+		sync->write<Mat4>(&view_instance_matrices[batch.offset], batch.count);
 	}
 }
 
 void View::draw_additive(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = View::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_additive.get(i.index) && (i.item()->mask & params.camera->mask))
-			i.item()->draw(params);
+		if (list_additive.get(i.index) && visible.get(i.index) && (i.item()->mask & params.camera->mask))
+			view_queue(i.item(), params, false); // additive blending doesn't care about order
 	}
+	RenderQueue::flush(params);
 }
 
 void View::draw_alpha(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = View::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_alpha.get(i.index) && (i.item()->mask & params.camera->mask))
-			i.item()->draw(params);
+		if (list_alpha.get(i.index) && visible.get(i.index) && (i.item()->mask & params.camera->mask))
+			view_queue(i.item(), params, true);
 	}
+	RenderQueue::flush(params);
 }
 
 void View::draw_alpha_depth(const RenderParams& params)
 {
+	const Bitmask<MAX_ENTITIES>& visible = cull_tree.query(params.camera);
 	for (auto i = View::list.iterator(); !i.is_last(); i.next())
 	{
-		if (list_alpha_depth.get(i.index) && (i.item()->mask & params.camera->mask))
-			i.item()->draw(params);
+		if (list_alpha_depth.get(i.index) && visible.get(i.index) && (i.item()->mask & params.camera->mask))
+			view_queue(i.item(), params, true);
 	}
+	RenderQueue::flush(params);
 }
 
 void View::alpha()
@@ -144,21 +354,11 @@ void View::draw(const RenderParams& params) const
 	if (mesh == AssetNull || shader == AssetNull)
 		return;
 
-	const Mesh* mesh_data = Loader::mesh(mesh);
-
 	Mat4 m;
-	get<Transform>()->mat(&m);
-	m = offset * m;
-
-	{
-		Vec3 radius = (offset * Vec4(mesh_data->bounds_radius, mesh_data->bounds_radius, mesh_data->bounds_radius, 0)).xyz();
-		if (!params.camera->visible_sphere(m.translation(), vi_max(radius.x, vi_max(radius.y, radius.z))))
-			return;
-	}
+	if (!view_visible(this, Loader::mesh(mesh), params, &m))
+		return;
 
-	// if allow_culled_shader is false, replace the culled shader with the standard shader.
-	b8 allow_culled_shader = params.camera->cull_range > 0.0f;
-	AssetID actual_shader = allow_culled_shader || shader != Asset::Shader::culled ? shader : Asset::Shader::standard;
+	AssetID actual_shader = view_shader(this, params);
 
 	Loader::shader(actual_shader);
 	Loader::texture(texture);
@@ -186,17 +386,7 @@ void View::draw(const RenderParams& params) const
 	sync->write(Asset::Uniform::diffuse_color);
 	sync->write(RenderDataType::Vec4);
 	sync->write<s32>(1);
-
-	if (team == (u8)AI::TeamNone)
-		sync->write<Vec4>(color);
-	else
-	{
-		const Vec4& team_color = Team::color((AI::Team)team, (AI::Team)params.camera->team);
-		if (list_alpha.get(id()) || list_additive.get(id()) || list_alpha_depth.get(id()))
-			sync->write<Vec4>(Vec4(team_color.xyz(), color.w));
-		else
-			sync->write<Vec4>(team_color);
-	}
+	sync->write<Vec4>(view_color(this, params));
 
 	if (actual_shader == Asset::Shader::culled)
 	{
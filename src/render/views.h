@@ -12,6 +12,7 @@ struct View : public ComponentType<View>
 	static Bitmask<MAX_ENTITIES> list_alpha;
 	static Bitmask<MAX_ENTITIES> list_additive;
 	static Bitmask<MAX_ENTITIES> list_alpha_depth;
+	static CullTree cull_tree;
 
 	Mat4 offset;
 	Vec4 color;
@@ -25,6 +26,7 @@ struct View : public ComponentType<View>
 	static void draw_alpha(const RenderParams&);
 	static void draw_alpha_depth(const RenderParams&);
 	static void draw_additive(const RenderParams&);
+	static void cull_build();
 
 	View(AssetID = AssetNull);
 	void awake();
@@ -37,6 +39,7 @@ struct View : public ComponentType<View>
 	void additive();
 	void alpha_disable();
 	void draw(const RenderParams&) const;
+	b8 instanceable(const RenderParams&) const;
 };
 
 struct Skybox
@@ -58,7 +61,7 @@ struct Skybox
 	static void draw_alpha(const RenderParams&, const Config&);
 };
 
-struct SkyDecal : ComponentType<SkyDecal>
+struct SkyDecal : ComponentType<SkyDecal, 64>
 {
 	Vec4 color;
 	r32 scale;
@@ -69,7 +72,7 @@ struct SkyDecal : ComponentType<SkyDecal>
 	void awake() {}
 };
 
-struct Water : public ComponentType<Water>
+struct Water : public ComponentType<Water, 64>
 {
 	Vec4 color;
 	r32 displacement_horizontal;
@@ -31,6 +31,7 @@ namespace Settings
 	extern ShadowQuality shadow_quality;
 	extern b8 volumetric_lighting;
 	extern b8 supersampling;
+	extern b8 tiled_lighting; // off falls back to drawing a sphere per point light
 };
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include "data/array.h"
 #include <thread>
@@ -9,63 +10,80 @@
 namespace VI
 {
 
+// byte ring buffer for exactly one producer thread and one consumer thread.
+// the producer writes a whole message and commits it; the consumer waits for committed data, reads a message, and commits the read.
+// nothing locks unless the consumer runs dry and has to sleep.
 template<s32 size> struct SyncRingBuffer
 {
-	s32 read_pos;
-	s32 write_pos;
-	mutable std::mutex mutex;
+	std::atomic<s32> read_pos; // committed by the consumer
+	std::atomic<s32> write_pos; // committed by the producer
+	std::atomic<b8> sleeping;
+	s32 read_cursor; // consumer only
+	s32 write_cursor; // producer only
 	Array<u8> data;
+	std::mutex mutex;
 	std::condition_variable condition;
 
 	SyncRingBuffer() :
-		read_pos(),
-		write_pos(),
-		mutex(),
+		read_pos(0),
+		write_pos(0),
+		sleeping(false),
+		read_cursor(),
+		write_cursor(),
 		data(size, size),
+		mutex(),
 		condition()
 	{
 	}
 
-	void lock_wait_read()
+	// consumer only. blocks until the producer commits something.
+	void read_wait()
 	{
-		while (true)
+		while (!can_read())
 		{
-			mutex.lock();
-			b8 can_read = read_pos != write_pos;
-			if (can_read)
-				break;
-			else
-			{
-				mutex.unlock();
-				platform::sleep(1.0f / 60.0f);
-			}
+			std::unique_lock<std::mutex> lock(mutex);
+			sleeping.store(true);
+			if (!can_read()) // the producer checks sleeping after committing, so we can't miss a wakeup
+				condition.wait(lock);
+			sleeping.store(false);
 		}
 	}
 
+	// consumer only
 	inline b8 can_read() const
 	{
-		return read_pos != write_pos;
+		return read_cursor != write_pos.load();
 	}
 
-	inline void lock()
+	// consumer only. frees everything read so far for the producer to reuse.
+	inline void read_commit()
 	{
-		mutex.lock();
+		read_pos.store(read_cursor, std::memory_order_release);
 	}
 
-	inline void unlock()
+	// producer only. makes everything written so far visible to the consumer.
+	inline void write_commit()
 	{
-		mutex.unlock();
+		write_pos.store(write_cursor);
+		if (sleeping.load())
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			condition.notify_one();
+		}
 	}
 
 	template<typename T> void write(const T* t, s32 count)
 	{
 		s32 write_size = sizeof(T) * count;
-		s32 write_end = write_pos + write_size;
-
-		if (read_pos < write_pos)
-			vi_assert(write_end - data.length < read_pos);
-		else if (read_pos > write_pos)
-			vi_assert(write_end < read_pos);
+		s32 write_end = write_cursor + write_size;
+
+#if DEBUG
+		s32 read = read_pos.load(std::memory_order_acquire);
+		if (read < write_cursor)
+			vi_assert(write_end - data.length < read);
+		else if (read > write_cursor)
+			vi_assert(write_end < read);
+#endif
 
 #if defined(__clang__)
 		// get ready to do gross things
@@ -74,15 +92,15 @@ template<s32 size> struct SyncRingBuffer
 #endif
 		if (write_end < data.length)
 		{
-			memcpy(&data[write_pos], t, write_size);
-			write_pos = write_end;
+			memcpy(&data[write_cursor], t, write_size);
+			write_cursor = write_end;
 		}
 		else
 		{
-			s32 partition = data.length - write_pos;
-			memcpy(&data[write_pos], t, partition);
-			write_pos = write_end - data.length;
-			memcpy(&data[0], ((u8*)t) + partition, write_pos);
+			s32 partition = data.length - write_cursor;
+			memcpy(&data[write_cursor], t, partition);
+			write_cursor = write_end - data.length;
+			memcpy(&data[0], ((u8*)t) + partition, write_cursor);
 		}
 #if defined(__clang__)
 #pragma clang diagnostic pop
@@ -99,7 +117,7 @@ template<s32 size> struct SyncRingBuffer
 		s32 read_len = sizeof(T) * count;
 		if (read_len == 0)
 			return;
-		s32 read_end = read_pos + read_len;
+		s32 read_end = read_cursor + read_len;
 
 #if defined(__clang__)
 		// get ready to do gross things
@@ -108,19 +126,19 @@ template<s32 size> struct SyncRingBuffer
 #endif
 		if (read_end >= data.length)
 		{
-			vi_assert(write_pos < read_pos);
-			s32 read_partition = data.length - read_pos;
-			vi_assert(read_len - read_partition <= write_pos);
+			vi_assert(write_pos.load(std::memory_order_relaxed) < read_cursor);
+			s32 read_partition = data.length - read_cursor;
+			vi_assert(read_len - read_partition <= write_pos.load(std::memory_order_relaxed));
 
-			memcpy(t, &data[read_pos], read_partition);
-			read_pos = read_len - read_partition;
-			memcpy(((u8*)t) + read_partition, &data[0], read_pos);
+			memcpy(t, &data[read_cursor], read_partition);
+			read_cursor = read_len - read_partition;
+			memcpy(((u8*)t) + read_partition, &data[0], read_cursor);
 		}
 		else
 		{
-			vi_assert(read_end <= write_pos == read_pos < write_pos);
-			memcpy(t, &data[read_pos], read_len);
-			read_pos = read_end;
+			vi_assert(read_end <= write_pos.load(std::memory_order_relaxed) == read_cursor < write_pos.load(std::memory_order_relaxed));
+			memcpy(t, &data[read_cursor], read_len);
+			read_cursor = read_end;
 		}
 #if defined(__clang__)
 #pragma clang diagnostic pop
@@ -128,6 +146,52 @@ template<s32 size> struct SyncRingBuffer
 	}
 };
 
+// lock-free queue of fixed-size slots for exactly one producer thread and one consumer thread.
+// items are written and read in place to avoid copying large payloads.
+template<typename T, s32 size> struct SyncQueue
+{
+	T items[size];
+	std::atomic<s32> read_pos;
+	std::atomic<s32> write_pos;
+
+	SyncQueue()
+		: read_pos(0), write_pos(0)
+	{
+	}
+
+	// producer only. returns null if the queue is full.
+	T* write_begin()
+	{
+		s32 pos = write_pos.load(std::memory_order_relaxed);
+		if ((pos + 1) % size == read_pos.load(std::memory_order_acquire))
+			return nullptr;
+		return &items[pos];
+	}
+
+	// producer only. publishes the item returned by write_begin()
+	void write_end()
+	{
+		s32 pos = write_pos.load(std::memory_order_relaxed);
+		write_pos.store((pos + 1) % size, std::memory_order_release);
+	}
+
+	// consumer only. returns null if the queue is empty.
+	T* read_begin()
+	{
+		s32 pos = read_pos.load(std::memory_order_relaxed);
+		if (pos == write_pos.load(std::memory_order_acquire))
+			return nullptr;
+		return &items[pos];
+	}
+
+	// consumer only. releases the item returned by read_begin()
+	void read_end()
+	{
+		s32 pos = read_pos.load(std::memory_order_relaxed);
+		read_pos.store((pos + 1) % size, std::memory_order_release);
+	}
+};
+
 enum SwapType
 {
 	SwapType_Read,
@@ -5,7 +5,11 @@
 namespace VI
 {
 
+// can be raised at build time for bigger levels. IDs are u16 and IDNull is MAX_ENTITIES, so it has to stay below 65536.
+#ifndef MAX_ENTITIES
 #define MAX_ENTITIES 2048
+#endif
+static_assert(MAX_ENTITIES > 0 && MAX_ENTITIES < 65536, "MAX_ENTITIES must fit in a u16 ID, with room for IDNull");
 
 typedef bool b8;
 